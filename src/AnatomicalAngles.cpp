@@ -0,0 +1,163 @@
+#include "AnatomicalAngles.h"
+
+#include <cmath>
+#include <algorithm>
+
+#define JOINT_COUNT 25
+#define CONFIDENCE_THRESHOLD 0.15f
+
+static const float RADIANS_TO_DEGREES = 180.0f / 3.14159265358979323846f;
+
+// Directions are in the local frame of the parent segment. Nuitrack gives every joint the
+// identity orientation in the T-pose, with x to the camera's right, y up and z away from the camera,
+// and the orientation of a joint follows its outgoing bone.
+struct AnatomicalJoint
+{
+	int parent; // Joint whose orientation is the parent segment
+	int proximal;
+	int distal;
+	float neutral[3]; // Segment direction at 0 flexion and abduction
+	float flexion[3]; // Direction of positive flexion
+	float abduction[3]; // Direction of positive abduction
+	float twist[3]; // Direction of the segment in the T-pose, the axis of its rotation
+};
+
+static const AnatomicalJoint anatomicalJoints[ANATOMICAL_JOINT_COUNT] = {
+	{ tdv::nuitrack::JOINT_TORSO, tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW, { 0, -1, 0 }, { 0, 0, -1 }, { 1, 0, 0 }, { 1, 0, 0 } },
+	{ tdv::nuitrack::JOINT_TORSO, tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW, { 0, -1, 0 }, { 0, 0, -1 }, { -1, 0, 0 }, { -1, 0, 0 } },
+	// The upper arm points sideways in the T-pose and the elbow bends forward
+	{ tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST, { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } },
+	{ tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST, { -1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 }, { -1, 0, 0 } },
+	{ tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_LEFT_KNEE, { 0, -1, 0 }, { 0, 0, -1 }, { 1, 0, 0 }, { 0, -1, 0 } },
+	{ tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_RIGHT_KNEE, { 0, -1, 0 }, { 0, 0, -1 }, { -1, 0, 0 }, { 0, -1, 0 } },
+	// The knee bends backwards
+	{ tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_ANKLE, { 0, -1, 0 }, { 0, 0, 1 }, { 1, 0, 0 }, { 0, -1, 0 } },
+	{ tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_ANKLE, { 0, -1, 0 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, -1, 0 } }
+};
+
+static float dot(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Rotates v by the inverse of the unit quaternion (w, x, y, z)
+static void rotateInverse(float w, float x, float y, float z, const float* v, float* result)
+{
+	// t = 2 * (-q.xyz cross v)
+	float tx = 2.0f * (-y * v[2] + z * v[1]);
+	float ty = 2.0f * (-z * v[0] + x * v[2]);
+	float tz = 2.0f * (-x * v[1] + y * v[0]);
+
+	// result = v + w * t + (-q.xyz) cross t
+	result[0] = v[0] + w * tx + (-y * tz + z * ty);
+	result[1] = v[1] + w * ty + (-z * tx + x * tz);
+	result[2] = v[2] + w * tz + (-x * ty + y * tx);
+}
+
+void AnatomicalAngles::compute(const std::vector<tdv::nuitrack::Joint>& joints, float angles[ANATOMICAL_JOINT_COUNT][ANATOMICAL_AXIS_COUNT])
+{
+	float qw[JOINT_COUNT];
+	float qx[JOINT_COUNT];
+	float qy[JOINT_COUNT];
+	float qz[JOINT_COUNT];
+	float valid[JOINT_COUNT];
+
+	// Rotation matrices to quaternions for every joint, without branches
+	for (int i = 0; i < JOINT_COUNT; i++)
+	{
+		const float* m = joints[i].orient.matrix;
+
+		qw[i] = 0.5f * std::sqrt((std::max)(0.0f, 1.0f + m[0] + m[4] + m[8]));
+		qx[i] = std::copysign(0.5f * std::sqrt((std::max)(0.0f, 1.0f + m[0] - m[4] - m[8])), m[7] - m[5]);
+		qy[i] = std::copysign(0.5f * std::sqrt((std::max)(0.0f, 1.0f - m[0] + m[4] - m[8])), m[2] - m[6]);
+		qz[i] = std::copysign(0.5f * std::sqrt((std::max)(0.0f, 1.0f - m[0] - m[4] + m[8])), m[3] - m[1]);
+
+		float norm = std::sqrt(qw[i] * qw[i] + qx[i] * qx[i] + qy[i] * qy[i] + qz[i] * qz[i]);
+		qw[i] /= norm;
+		qx[i] /= norm;
+		qy[i] /= norm;
+		qz[i] /= norm;
+
+		// A rotation matrix has a squared norm of 3, untracked joints get the zero matrix
+		float squaredNorm = 0.0f;
+		for (int j = 0; j < 9; j++)
+			squaredNorm += m[j] * m[j];
+
+		valid[i] = (squaredNorm > 1.5f && joints[i].confidence > CONFIDENCE_THRESHOLD) ? 1.0f : 0.0f;
+	}
+
+	for (int i = 0; i < ANATOMICAL_JOINT_COUNT; i++)
+	{
+		const AnatomicalJoint& joint = anatomicalJoints[i];
+		const int p = joint.parent;
+		const int c = joint.proximal;
+
+		const tdv::nuitrack::Vector3& a = joints[joint.proximal].real;
+		const tdv::nuitrack::Vector3& b = joints[joint.distal].real;
+		float segment[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+		float length = std::sqrt(dot(segment, segment));
+
+		if (valid[p] * valid[c] == 0.0f || joints[joint.distal].confidence <= CONFIDENCE_THRESHOLD || length < 1e-3f)
+		{
+			angles[i][ANATOMICAL_FLEXION] = 0.0f;
+			angles[i][ANATOMICAL_ABDUCTION] = 0.0f;
+			angles[i][ANATOMICAL_ROTATION] = 0.0f;
+			continue;
+		}
+
+		// Segment direction in the parent frame
+		float local[3];
+		rotateInverse(qw[p], qx[p], qy[p], qz[p], segment, local);
+
+		// Flexion is measured in the sagittal plane, abduction as the elevation out of it so that it
+		// stays continuous when the segment is flexed past 90 degrees
+		float neutral = dot(local, joint.neutral);
+		float flexion = dot(local, joint.flexion);
+		angles[i][ANATOMICAL_FLEXION] = std::atan2(flexion, neutral) * RADIANS_TO_DEGREES;
+		angles[i][ANATOMICAL_ABDUCTION] = std::atan2(dot(local, joint.abduction), std::sqrt(neutral * neutral + flexion * flexion)) * RADIANS_TO_DEGREES;
+
+		// Child orientation relative to the parent, conj(parent) * child
+		float rw = qw[p] * qw[c] + qx[p] * qx[c] + qy[p] * qy[c] + qz[p] * qz[c];
+		float rx = qw[p] * qx[c] - qx[p] * qw[c] - qy[p] * qz[c] + qz[p] * qy[c];
+		float ry = qw[p] * qy[c] + qx[p] * qz[c] - qy[p] * qw[c] - qz[p] * qx[c];
+		float rz = qw[p] * qz[c] - qx[p] * qy[c] + qy[p] * qx[c] - qz[p] * qw[c];
+
+		// Twist around the child segment from the swing-twist decomposition, the relative rotation
+		// is identity in the T-pose so the axis is the segment direction there
+		float relative[3] = { rx, ry, rz };
+		float twist = 2.0f * std::atan2(dot(relative, joint.twist), rw) * RADIANS_TO_DEGREES;
+		if (twist > 180.0f)
+			twist -= 360.0f;
+		else if (twist <= -180.0f)
+			twist += 360.0f;
+
+		angles[i][ANATOMICAL_ROTATION] = twist;
+	}
+}
+
+const char* AnatomicalAngles::getJointName(int joint)
+{
+	static const char* names[ANATOMICAL_JOINT_COUNT] = {
+		"Left shoulder",
+		"Right shoulder",
+		"Left elbow",
+		"Right elbow",
+		"Left hip",
+		"Right hip",
+		"Left knee",
+		"Right knee"
+	};
+
+	return names[joint];
+}
+
+const char* AnatomicalAngles::getAxisName(int axis)
+{
+	static const char* names[ANATOMICAL_AXIS_COUNT] = {
+		"Flexion",
+		"Abduction",
+		"Rotation"
+	};
+
+	return names[axis];
+}
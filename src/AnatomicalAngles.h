@@ -0,0 +1,30 @@
+#pragma once
+
+#include <nuitrack/Nuitrack.h>
+#include <vector>
+
+#define ANATOMICAL_JOINT_COUNT 8
+#define ANATOMICAL_AXIS_COUNT 3
+
+enum AnatomicalAxis
+{
+	ANATOMICAL_FLEXION = 0,
+	ANATOMICAL_ABDUCTION = 1,
+	ANATOMICAL_ROTATION = 2
+};
+
+// Flexion, abduction and axial rotation of the shoulders, elbows, hips and knees in degrees.
+// Unlike the projected angles these do not change when the patient turns towards the camera:
+// each segment direction from the real world coordinates is expressed in the frame of its parent
+// segment, taken from the joint orientations, and the rotation is the twist of the child relative
+// to the parent around the segment. All 25 orientation matrices are converted to quaternions in one
+// branchless pass over structure of arrays, which the compiler can vectorize.
+class AnatomicalAngles
+{
+public:
+	// Angles of joints that are not tracked are set to 0
+	static void compute(const std::vector<tdv::nuitrack::Joint>& joints, float angles[ANATOMICAL_JOINT_COUNT][ANATOMICAL_AXIS_COUNT]);
+
+	static const char* getJointName(int joint);
+	static const char* getAxisName(int axis);
+};
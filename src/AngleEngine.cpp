@@ -0,0 +1,301 @@
+#include "AngleEngine.h"
+#include "NuitrackGL.h"
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANGLE_ENGINE_SSE
+#endif
+
+#define JOINT_COUNT 25
+
+struct AngleTriplet
+{
+	int a;
+	int b; // Vertex of the angle
+	int c;
+};
+
+static const AngleTriplet angleTriplets[ENGINE_ANGLE_COUNT] = {
+	{ tdv::nuitrack::JOINT_LEFT_ANKLE, tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_HIP },
+	{ tdv::nuitrack::JOINT_RIGHT_ANKLE, tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_HIP },
+	{ tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_RIGHT_HIP },
+	{ tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_WAIST },
+	{ tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_WAIST },
+	{ tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_TORSO },
+	{ tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_TORSO },
+	{ tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_TORSO, tdv::nuitrack::JOINT_LEFT_COLLAR }, // Joint left collar same as joint right collar
+	{ tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_TORSO },
+	{ tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_TORSO },
+	{ tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_LEFT_SHOULDER },
+	{ tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_RIGHT_SHOULDER },
+	{ tdv::nuitrack::JOINT_HEAD, tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR },
+	{ tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW },
+	{ tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW },
+	{ tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST },
+	{ tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST },
+	{ tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST, tdv::nuitrack::JOINT_LEFT_HAND },
+	{ tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST, tdv::nuitrack::JOINT_RIGHT_HAND }
+};
+
+static const float PI = 3.14159265358979323846f;
+static const float RADIANS_TO_DEGREES = 180.0f / PI;
+
+// Minimax polynomial for atan on [0, 1] in terms of x^2, maximum error about 1e-4 degrees as measured by benchmark()
+static const float ATAN_C0 = 0.99997726f;
+static const float ATAN_C1 = -0.33262347f;
+static const float ATAN_C2 = 0.19354346f;
+static const float ATAN_C3 = -0.11643287f;
+static const float ATAN_C4 = 0.05265332f;
+static const float ATAN_C5 = -0.01172120f;
+
+#ifdef ANGLE_ENGINE_SSE
+
+// atan2(y, x) in degrees for four lanes. The ratio of the smaller to the larger component
+// keeps the polynomial in [0, 1], and the octant is restored from the signs and the swap.
+static __m128 atan2Degrees(__m128 y, __m128 x)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	__m128 ax = _mm_andnot_ps(signMask, x);
+	__m128 ay = _mm_andnot_ps(signMask, y);
+	__m128 mn = _mm_min_ps(ax, ay);
+	__m128 mx = _mm_max_ps(ax, ay);
+
+	// atan2(0, 0) is 0, like std::atan2
+	__m128 a = _mm_div_ps(mn, _mm_max_ps(mx, _mm_set1_ps(1e-30f)));
+	__m128 s = _mm_mul_ps(a, a);
+
+	__m128 r = _mm_set1_ps(ATAN_C5);
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C4));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C3));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C2));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C1));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C0));
+	r = _mm_mul_ps(r, a);
+
+	__m128 swapped = _mm_cmpgt_ps(ay, ax);
+	r = _mm_or_ps(_mm_and_ps(swapped, _mm_sub_ps(_mm_set1_ps(0.5f * PI), r)), _mm_andnot_ps(swapped, r));
+
+	__m128 negativeX = _mm_cmplt_ps(x, _mm_setzero_ps());
+	r = _mm_or_ps(_mm_and_ps(negativeX, _mm_sub_ps(_mm_set1_ps(PI), r)), _mm_andnot_ps(negativeX, r));
+
+	// Copy the sign of y
+	r = _mm_or_ps(r, _mm_and_ps(signMask, y));
+
+	return _mm_mul_ps(r, _mm_set1_ps(RADIANS_TO_DEGREES));
+}
+
+// Same rounding as the scalar path: nearest degree, negative angles wrapped to 0-360
+static __m128i roundAngles(__m128 degrees)
+{
+	// Shifted to be positive so truncation is the same as floor
+	__m128i shifted = _mm_cvttps_epi32(_mm_add_ps(degrees, _mm_set1_ps(360.5f)));
+	__m128i wrapped = _mm_sub_epi32(shifted, _mm_set1_epi32(360));
+	__m128i negative = _mm_cmplt_epi32(wrapped, _mm_setzero_si128());
+	return _mm_or_si128(_mm_and_si128(negative, shifted), _mm_andnot_si128(negative, wrapped));
+}
+
+#else
+
+static float atan2Degrees(float y, float x)
+{
+	float ax = std::fabs(x);
+	float ay = std::fabs(y);
+	float mx = (std::max)(ax, ay);
+	float a = (std::min)(ax, ay) / (std::max)(mx, 1e-30f);
+	float s = a * a;
+
+	float r = ((((ATAN_C5 * s + ATAN_C4) * s + ATAN_C3) * s + ATAN_C2) * s + ATAN_C1) * s + ATAN_C0;
+	r *= a;
+
+	if (ay > ax)
+		r = 0.5f * PI - r;
+	if (x < 0)
+		r = PI - r;
+
+	return std::copysign(r, y) * RADIANS_TO_DEGREES;
+}
+
+static int roundAngle(float degrees)
+{
+	int shifted = (int)(degrees + 360.5f);
+	return shifted >= 360 ? shifted - 360 : shifted;
+}
+
+#endif
+
+void AngleEngine::compute(const std::vector<tdv::nuitrack::Joint>& joints, int* angles) const
+{
+	float x[JOINT_COUNT];
+	float y[JOINT_COUNT];
+
+	for (int i = 0; i < JOINT_COUNT; i++)
+	{
+		x[i] = joints[i].proj.x;
+		y[i] = joints[i].proj.y;
+	}
+
+	compute(x, y, angles);
+}
+
+void AngleEngine::compute(const JointFrame& frame, int* angles) const
+{
+	float x[JOINT_COUNT];
+	float y[JOINT_COUNT];
+
+	for (int i = 0; i < JOINT_COUNT; i++)
+	{
+		x[i] = frame.joints[i].x;
+		y[i] = frame.joints[i].y;
+	}
+
+	compute(x, y, angles);
+}
+
+void AngleEngine::compute(const float* x, const float* y, int* angles) const
+{
+	const int padded = (ENGINE_ANGLE_COUNT + 3) & ~3;
+
+	// Structure of arrays, one entry per angle
+	float abx[ENGINE_ANGLE_COUNT + 3];
+	float aby[ENGINE_ANGLE_COUNT + 3];
+	float cbx[ENGINE_ANGLE_COUNT + 3];
+	float cby[ENGINE_ANGLE_COUNT + 3];
+	int result[ENGINE_ANGLE_COUNT + 3];
+
+	for (int i = 0; i < padded; i++)
+	{
+		// Padding lanes repeat the last angle so the gather never reads outside the table
+		const AngleTriplet& t = angleTriplets[(std::min)(i, ENGINE_ANGLE_COUNT - 1)];
+		abx[i] = x[t.b] - x[t.a];
+		aby[i] = y[t.b] - y[t.a];
+		cbx[i] = x[t.b] - x[t.c];
+		cby[i] = y[t.b] - y[t.c];
+	}
+
+#ifdef ANGLE_ENGINE_SSE
+	for (int i = 0; i < padded; i += 4)
+	{
+		__m128 ax = _mm_loadu_ps(abx + i);
+		__m128 ay = _mm_loadu_ps(aby + i);
+		__m128 cx = _mm_loadu_ps(cbx + i);
+		__m128 cy = _mm_loadu_ps(cby + i);
+
+		__m128 dot = _mm_add_ps(_mm_mul_ps(ax, cx), _mm_mul_ps(ay, cy));
+		__m128 cross = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+
+		_mm_storeu_si128((__m128i*)(result + i), roundAngles(atan2Degrees(cross, dot)));
+	}
+#else
+	for (int i = 0; i < padded; i++)
+	{
+		float dot = abx[i] * cbx[i] + aby[i] * cby[i];
+		float cross = abx[i] * cby[i] - aby[i] * cbx[i];
+		result[i] = roundAngle(atan2Degrees(cross, dot));
+	}
+#endif
+
+	for (int i = 0; i < ENGINE_ANGLE_COUNT; i++)
+		angles[i] = result[i];
+}
+
+int AngleEngine::computeScalar(const float* x, const float* y, int angle)
+{
+	const AngleTriplet& t = angleTriplets[angle];
+
+	float abx = x[t.b] - x[t.a];
+	float aby = y[t.b] - y[t.a];
+	float cbx = x[t.b] - x[t.c];
+	float cby = y[t.b] - y[t.c];
+
+	float dot = abx * cbx + aby * cby;
+	float cross = abx * cby - aby * cbx;
+
+	float alpha = atan2(cross, dot);
+
+	int retVal = (int)floor(alpha * 180. / PI + 0.5);
+
+	if (retVal < 0)
+		retVal = 360 + retVal;
+
+	return retVal;
+}
+
+AngleBenchmark AngleEngine::benchmark(int samples)
+{
+	AngleBenchmark report;
+	report.samples = samples;
+	report.maxError = 0.0f;
+	report.mismatches = 0;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(0.0f, 1.0f);
+
+	std::vector<float> x(samples * JOINT_COUNT);
+	std::vector<float> y(samples * JOINT_COUNT);
+	for (int i = 0; i < samples * JOINT_COUNT; i++)
+	{
+		x[i] = position(random);
+		y[i] = position(random);
+	}
+
+	std::vector<int> scalar(samples * ENGINE_ANGLE_COUNT);
+	std::vector<int> simd(samples * ENGINE_ANGLE_COUNT);
+	AngleEngine engine;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < samples; i++)
+	{
+		for (int j = 0; j < ENGINE_ANGLE_COUNT; j++)
+			scalar[i * ENGINE_ANGLE_COUNT + j] = computeScalar(&x[i * JOINT_COUNT], &y[i * JOINT_COUNT], j);
+	}
+	auto middle = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < samples; i++)
+	{
+		engine.compute(&x[i * JOINT_COUNT], &y[i * JOINT_COUNT], &simd[i * ENGINE_ANGLE_COUNT]);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	report.scalarNs = std::chrono::duration<double, std::nano>(middle - start).count() / samples;
+	report.simdNs = std::chrono::duration<double, std::nano>(end - middle).count() / samples;
+
+	// Angles exactly halfway between two degrees may round either way, everything else must match
+	for (int i = 0; i < samples * ENGINE_ANGLE_COUNT; i++)
+	{
+		if (scalar[i] != simd[i])
+			report.mismatches++;
+	}
+
+	// Error of the approximation itself over the whole circle
+	for (int i = 0; i < samples * 4; i += 4)
+	{
+		float dx[4];
+		float dy[4];
+		float approx[4];
+		for (int j = 0; j < 4; j++)
+		{
+			dx[j] = position(random) * 2.0f - 1.0f;
+			dy[j] = position(random) * 2.0f - 1.0f;
+		}
+
+#ifdef ANGLE_ENGINE_SSE
+		_mm_storeu_ps(approx, atan2Degrees(_mm_loadu_ps(dy), _mm_loadu_ps(dx)));
+#else
+		for (int j = 0; j < 4; j++)
+			approx[j] = atan2Degrees(dy[j], dx[j]);
+#endif
+
+		for (int j = 0; j < 4; j++)
+		{
+			float exact = (float)(atan2((double)dy[j], (double)dx[j]) * 180.0 / 3.14159265358979323846);
+			report.maxError = (std::max)(report.maxError, std::fabs(approx[j] - exact));
+		}
+	}
+
+	return report;
+}
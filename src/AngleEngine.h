@@ -0,0 +1,40 @@
+#pragma once
+
+#include <nuitrack/Nuitrack.h>
+#include <vector>
+#include <cstdint>
+
+#define ENGINE_ANGLE_COUNT 19
+#define ENGINE_ALL_ANGLES ((1u << ENGINE_ANGLE_COUNT) - 1)
+
+struct JointFrame;
+
+struct AngleBenchmark
+{
+	double scalarNs; // Time per skeleton for the std::atan2 path
+	double simdNs; // Time per skeleton for the engine
+	float maxError; // Largest difference before rounding, in degrees
+	int mismatches; // Rounded angles that differ from the scalar path
+	int samples;
+};
+
+// Computes the 19 joint angles from the projected joint positions.
+// Every angle is a triplet of joints in a fixed table, the vectors of all angles are
+// gathered into structure of arrays form and evaluated four at a time with SSE, using a
+// polynomial atan2 whose error is about 1e-4 degrees, far under the rounding to whole degrees.
+// All angles are always computed, selecting the ones an exercise scores is up to the caller.
+class AngleEngine
+{
+public:
+	void compute(const std::vector<tdv::nuitrack::Joint>& joints, int* angles) const;
+	void compute(const JointFrame& frame, int* angles) const;
+
+	// Reference implementation with std::atan2, one angle at a time
+	static int computeScalar(const float* x, const float* y, int angle);
+
+	// Times both paths on random skeletons and compares their results
+	static AngleBenchmark benchmark(int samples);
+
+private:
+	void compute(const float* x, const float* y, int* angles) const;
+};
@@ -0,0 +1,229 @@
+#include "AngleStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+#define BUFFER_SIZE 256
+
+static const double PI = 3.14159265358979323846;
+
+TDigest::TDigest(float compression) :
+	compression(compression)
+{
+	// Reserve everything up front so adding values never allocates
+	centroids.reserve((size_t)(2 * compression) + BUFFER_SIZE);
+	scratch.reserve((size_t)(2 * compression) + BUFFER_SIZE);
+	buffer.reserve(BUFFER_SIZE);
+	clear();
+}
+
+void TDigest::add(float value, float weight)
+{
+	Centroid c = { value, weight };
+	buffer.push_back(c);
+
+	totalWeight += weight;
+	minValue = (std::min)(minValue, value);
+	maxValue = (std::max)(maxValue, value);
+
+	if (buffer.size() >= BUFFER_SIZE)
+		compress();
+}
+
+void TDigest::merge(const TDigest& other)
+{
+	if (other.totalWeight == 0)
+		return;
+
+	// Totals are updated first so the weight limits used while compressing are correct
+	totalWeight += other.totalWeight;
+	minValue = (std::min)(minValue, other.minValue);
+	maxValue = (std::max)(maxValue, other.maxValue);
+
+	for (const Centroid& c : other.centroids)
+	{
+		buffer.push_back(c);
+		if (buffer.size() >= BUFFER_SIZE)
+			compress();
+	}
+
+	for (const Centroid& c : other.buffer)
+	{
+		buffer.push_back(c);
+		if (buffer.size() >= BUFFER_SIZE)
+			compress();
+	}
+
+	compress();
+}
+
+void TDigest::clear()
+{
+	centroids.clear();
+	buffer.clear();
+	totalWeight = 0;
+	minValue = FLT_MAX;
+	maxValue = -FLT_MAX;
+}
+
+float TDigest::quantile(float q)
+{
+	compress();
+
+	if (centroids.empty())
+		return 0.0f;
+
+	if (q <= 0.0f)
+		return minValue;
+	if (q >= 1.0f)
+		return maxValue;
+
+	double index = q * totalWeight;
+
+	// Each centroid is treated as sitting in the middle of the weight it covers
+	double weightSoFar = 0;
+	double previousCenter = 0;
+	float previousMean = minValue;
+
+	for (const Centroid& c : centroids)
+	{
+		double center = weightSoFar + c.weight / 2.0;
+
+		if (index < center)
+		{
+			double t = (index - previousCenter) / (center - previousCenter);
+			return (float)(previousMean + t * (c.mean - previousMean));
+		}
+
+		weightSoFar += c.weight;
+		previousCenter = center;
+		previousMean = c.mean;
+	}
+
+	// Between the last centroid and the maximum
+	double t = (index - previousCenter) / (totalWeight - previousCenter);
+	return (float)(previousMean + t * (maxValue - previousMean));
+}
+
+const std::vector<Centroid>& TDigest::getCentroids()
+{
+	compress();
+	return centroids;
+}
+
+void TDigest::load(const std::vector<Centroid>& loaded, float min, float max)
+{
+	clear();
+
+	for (const Centroid& c : loaded)
+	{
+		buffer.push_back(c);
+		totalWeight += c.weight;
+		if (buffer.size() >= BUFFER_SIZE)
+			compress();
+	}
+
+	minValue = min;
+	maxValue = max;
+
+	compress();
+}
+
+// Weight the current centroid may grow to, using the k1 scale function.
+// Centroids near the tails are kept small so the extreme quantiles stay accurate.
+double TDigest::getWeightLimit(double weightSoFar) const
+{
+	double q = weightSoFar / totalWeight;
+	double k = compression / (2 * PI) * asin(2 * q - 1) + 1;
+
+	if (k >= compression / 4)
+		return totalWeight;
+
+	double qLimit = (sin(k * 2 * PI / compression) + 1) / 2;
+	return qLimit * totalWeight;
+}
+
+void TDigest::compress()
+{
+	if (buffer.empty())
+		return;
+
+	scratch.clear();
+	scratch.insert(scratch.end(), centroids.begin(), centroids.end());
+	scratch.insert(scratch.end(), buffer.begin(), buffer.end());
+	buffer.clear();
+
+	std::sort(scratch.begin(), scratch.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+
+	centroids.clear();
+
+	Centroid current = scratch[0];
+	double weightSoFar = 0;
+	double weightLimit = getWeightLimit(0);
+
+	for (size_t i = 1; i < scratch.size(); i++)
+	{
+		const Centroid& next = scratch[i];
+
+		if (weightSoFar + current.weight + next.weight <= weightLimit)
+		{
+			current.mean += (next.mean - current.mean) * next.weight / (current.weight + next.weight);
+			current.weight += next.weight;
+		}
+		else
+		{
+			weightSoFar += current.weight;
+			centroids.push_back(current);
+			weightLimit = getWeightLimit(weightSoFar);
+			current = next;
+		}
+	}
+
+	centroids.push_back(current);
+}
+
+void AngleStatistics::add(const int* angles)
+{
+	for (int i = 0; i < ANGLE_COUNT; i++)
+		digests[i].add((float)angles[i]);
+}
+
+void AngleStatistics::merge(const AngleStatistics& other)
+{
+	for (int i = 0; i < ANGLE_COUNT; i++)
+		digests[i].merge(other.digests[i]);
+}
+
+void AngleStatistics::clear()
+{
+	for (int i = 0; i < ANGLE_COUNT; i++)
+		digests[i].clear();
+}
+
+const char* AngleStatistics::getAngleName(int angle)
+{
+	static const char* names[ANGLE_COUNT] = {
+		"Left knee",
+		"Right knee",
+		"Pelvis",
+		"Left hip",
+		"Right hip",
+		"Left waist",
+		"Right waist",
+		"Spine",
+		"Left collar",
+		"Right collar",
+		"Left neck",
+		"Right neck",
+		"Head",
+		"Left shoulder",
+		"Right shoulder",
+		"Left elbow",
+		"Right elbow",
+		"Left wrist",
+		"Right wrist"
+	};
+
+	return names[angle];
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+struct Centroid
+{
+	float mean;
+	float weight;
+};
+
+// Merging t-digest (Dunning & Ertl). Keeps an approximation of the value distribution
+// in a bounded number of centroids, so memory stays constant no matter how many values are added.
+// Two digests can be merged without going back to the raw data.
+class TDigest
+{
+public:
+	TDigest(float compression = 100.0f);
+
+	void add(float value, float weight = 1.0f);
+	void merge(const TDigest& other);
+	void clear();
+
+	// q in [0, 1]
+	float quantile(float q);
+
+	float getMin() const { return minValue; }
+	float getMax() const { return maxValue; }
+	double getCount() const { return totalWeight; }
+
+	// Used to save and restore the digest
+	const std::vector<Centroid>& getCentroids();
+	void load(const std::vector<Centroid>& centroids, float min, float max);
+
+private:
+	float compression;
+	double totalWeight;
+	float minValue;
+	float maxValue;
+
+	std::vector<Centroid> centroids;
+	std::vector<Centroid> buffer; // Values that have not been merged into the centroids yet
+	std::vector<Centroid> scratch;
+
+	void compress();
+	double getWeightLimit(double weightSoFar) const;
+};
+
+// Range of motion statistics for each of the 19 joint angles
+class AngleStatistics
+{
+public:
+	static const int ANGLE_COUNT = 19;
+
+	void add(const int* angles);
+	void merge(const AngleStatistics& other);
+	void clear();
+
+	TDigest& getDigest(int angle) { return digests[angle]; }
+	const TDigest& getDigest(int angle) const { return digests[angle]; }
+
+	static const char* getAngleName(int angle);
+
+private:
+	TDigest digests[ANGLE_COUNT];
+};
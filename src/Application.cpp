@@ -1,5 +1,8 @@
 
 #include "NuitrackGL.h"
+#include "ShaderManager.h"
+#include "SessionExporter.h"
+#include "DiskHelper.h"
 #include "GLFW/glfw3.h"
 
 #include "imgui/imgui.h"
@@ -8,6 +11,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cstdlib>
 #include <direct.h>
 
 #define GetCurrentDir _getcwd
@@ -17,6 +22,7 @@ NuitrackGL sample;
 void showHelpInfo()
 {
 	std::cout << "Usage: nuitrack_gl_sample [path/to/nuitrack.config]\n"
+		"       nuitrack_gl_sample --export-session session.txt trainer.txt output.avi [width height]\n"
 		"Press Esc to close window." << std::endl;
 }
 
@@ -27,6 +33,191 @@ std::string get_current_dir() {
 	return current_working_dir;
 }
 
+void showAngleStatistics(AngleStatistics& statistics)
+{
+	ImGui::Columns(5, "angleStatistics");
+	ImGui::Separator();
+	ImGui::Text("Angle"); ImGui::NextColumn();
+	ImGui::Text("Min"); ImGui::NextColumn();
+	ImGui::Text("Median"); ImGui::NextColumn();
+	ImGui::Text("P95"); ImGui::NextColumn();
+	ImGui::Text("Max"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (int i = 0; i < AngleStatistics::ANGLE_COUNT; i++)
+	{
+		TDigest& digest = statistics.getDigest(i);
+
+		ImGui::Text("%s", AngleStatistics::getAngleName(i)); ImGui::NextColumn();
+		if (digest.getCount() > 0)
+		{
+			ImGui::Text("%.0f", digest.getMin()); ImGui::NextColumn();
+			ImGui::Text("%.0f", digest.quantile(0.5f)); ImGui::NextColumn();
+			ImGui::Text("%.0f", digest.quantile(0.95f)); ImGui::NextColumn();
+			ImGui::Text("%.0f", digest.getMax()); ImGui::NextColumn();
+		}
+		else
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				ImGui::Text("-"); ImGui::NextColumn();
+			}
+		}
+	}
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+}
+
+void showSymmetry(const SymmetryAnalyzer& analyzer)
+{
+	ImGui::Columns(6, "symmetry");
+	ImGui::Separator();
+	ImGui::Text("Pair"); ImGui::NextColumn();
+	ImGui::Text("Reps"); ImGui::NextColumn();
+	ImGui::Text("Range L/R"); ImGui::NextColumn();
+	ImGui::Text("Index"); ImGui::NextColumn();
+	ImGui::Text("Difference"); ImGui::NextColumn();
+	ImGui::Text("Lag"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (int i = 0; i < SYMMETRY_PAIR_COUNT; i++)
+	{
+		const SymmetryReport& report = analyzer.getReport(i);
+
+		ImGui::Text("%s", SymmetryAnalyzer::getPairName(i)); ImGui::NextColumn();
+		ImGui::Text("%d", report.reps); ImGui::NextColumn();
+		ImGui::Text("%.0f/%.0f", report.leftRange, report.rightRange); ImGui::NextColumn();
+		ImGui::Text("%.1f%%", report.symmetryIndex); ImGui::NextColumn();
+		ImGui::Text("%.1f", report.meanDifference); ImGui::NextColumn();
+		ImGui::Text("%d (%.2f)", report.lag, report.correlation); ImGui::NextColumn();
+	}
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+}
+
+// Patient angles next to the trainer's when a recording is replayed
+void showAnatomicalAngles(const JointFrame& patient, const JointFrame* trainer)
+{
+	ImGui::Columns(trainer ? 3 : 2, "anatomical");
+	ImGui::Separator();
+	ImGui::Text("Joint"); ImGui::NextColumn();
+	ImGui::Text("Patient F/A/R"); ImGui::NextColumn();
+	if (trainer)
+	{
+		ImGui::Text("Trainer F/A/R"); ImGui::NextColumn();
+	}
+	ImGui::Separator();
+
+	for (int i = 0; i < ANATOMICAL_JOINT_COUNT; i++)
+	{
+		const float* p = patient.anatomicalAngles[i];
+
+		ImGui::Text("%s", AnatomicalAngles::getJointName(i)); ImGui::NextColumn();
+		ImGui::Text("%.0f / %.0f / %.0f", p[ANATOMICAL_FLEXION], p[ANATOMICAL_ABDUCTION], p[ANATOMICAL_ROTATION]); ImGui::NextColumn();
+		if (trainer)
+		{
+			const float* t = trainer->anatomicalAngles[i];
+			ImGui::Text("%.0f / %.0f / %.0f", t[ANATOMICAL_FLEXION], t[ANATOMICAL_ABDUCTION], t[ANATOMICAL_ROTATION]); ImGui::NextColumn();
+		}
+	}
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+}
+
+// Everybody in view with their score against the trainer, the patient can be picked here
+void showUsers(NuitrackGL& sample)
+{
+	int patient = sample.getPatientSetting();
+
+	ImGui::RadioButton("Patient tracked the longest", &patient, 0);
+
+	ImGui::Columns(4, "users");
+	ImGui::Separator();
+	ImGui::Text("Patient"); ImGui::NextColumn();
+	ImGui::Text("User"); ImGui::NextColumn();
+	ImGui::Text("Tracking"); ImGui::NextColumn();
+	ImGui::Text("Score"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (const auto& entry : sample.getUsers())
+	{
+		const TrackedUser& user = entry.second;
+
+		ImGui::PushID(user.id);
+		ImGui::RadioButton("", &patient, user.id); ImGui::NextColumn();
+		ImGui::PopID();
+		ImGui::Text("%d", user.id); ImGui::NextColumn();
+		ImGui::Text("%s", user.hasAllJoints ? "Complete" : "Partial"); ImGui::NextColumn();
+		if (user.score >= 0)
+			ImGui::Text("%d", user.score);
+		else
+			ImGui::Text("-");
+		ImGui::NextColumn();
+	}
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+
+	sample.setPatient(patient);
+}
+
+void showSmoothness(const SmoothnessReport* reports)
+{
+	ImGui::Columns(3, "smoothness");
+	ImGui::Separator();
+	ImGui::Text("Joint"); ImGui::NextColumn();
+	ImGui::Text("SPARC"); ImGui::NextColumn();
+	ImGui::Text("Jerk"); ImGui::NextColumn();
+	ImGui::Separator();
+
+	for (int i = 0; i < SMOOTHNESS_JOINT_COUNT; i++)
+	{
+		ImGui::Text("%s", SmoothnessAnalyzer::getJointName(i)); ImGui::NextColumn();
+		if (reports[i].windows > 0)
+		{
+			ImGui::Text("%.2f", reports[i].sparc); ImGui::NextColumn();
+			ImGui::Text("%.2f", reports[i].jerk); ImGui::NextColumn();
+		}
+		else
+		{
+			ImGui::Text("-"); ImGui::NextColumn();
+			ImGui::Text("-"); ImGui::NextColumn();
+		}
+	}
+
+	ImGui::Columns(1);
+	ImGui::Separator();
+}
+
+// Draw a small picture of a recorded pose, mirrored the same way as the main view
+void drawSkeletonThumbnail(const JointFrame& frame, float size, bool highlight)
+{
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+
+	drawList->AddRectFilled(origin, ImVec2(origin.x + size, origin.y + size), IM_COL32(30, 30, 30, 255));
+	if (highlight)
+		drawList->AddRect(origin, ImVec2(origin.x + size, origin.y + size), IM_COL32(0, 255, 0, 255), 0.0f, 0, 2.0f);
+
+	for (int i = 0; i < BONE_COUNT; i++)
+	{
+		int a = skeletonBones[i][0];
+		int b = skeletonBones[i][1];
+
+		if (frame.confidence[a] <= 0.15f || frame.confidence[b] <= 0.15f)
+			continue;
+
+		ImVec2 p1(origin.x + (1.0f - frame.joints[a].x) * size, origin.y + frame.joints[a].y * size);
+		ImVec2 p2(origin.x + (1.0f - frame.joints[b].x) * size, origin.y + frame.joints[b].y * size);
+		drawList->AddLine(p1, p2, IM_COL32(255, 105, 0, 255), 2.0f);
+	}
+
+	ImGui::Dummy(ImVec2(size, size));
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	// make sure the viewport matches the new window dimensions; note that width and 
@@ -34,10 +225,78 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
+// Export without Nuitrack or a visible window, the context belongs to a hidden window
+int exportSessionHeadless(int argc, char* argv[])
+{
+	if (argc < 5)
+	{
+		showHelpInfo();
+		return -1;
+	}
+
+	int width = argc >= 7 ? std::atoi(argv[5]) : 640;
+	int height = argc >= 7 ? std::atoi(argv[6]) : 480;
+	if (width <= 0 || height <= 0)
+	{
+		showHelpInfo();
+		return -1;
+	}
+
+	if (!glfwInit())
+	{
+		std::cout << "Failed to initialize GLFW" << std::endl;
+		return -1;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	GLFWwindow* window = glfwCreateWindow(16, 16, "Export", NULL, NULL);
+	if (!window)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+
+	ShaderManager::init("shadercache");
+	ShaderManager::prewarm();
+
+	bool exported;
+	{
+		std::vector<SessionFrame> session;
+		std::vector<JointFrame> trainer;
+		DiskHelper::readSessionFromDisk(argv[2], session);
+		DiskHelper::readDatafromDisk(argv[3], trainer);
+
+		SessionExporter exporter;
+		exported = exporter.exportSession(session, trainer, argv[4], width, height);
+	}
+
+	ShaderManager::release();
+	glfwDestroyWindow(window);
+	glfwTerminate();
+
+	return exported ? 0 : -1;
+}
+
 int main(int argc, char* argv[])
 {
 	std::cout << get_current_dir() << std::endl;
 
+	if (argc >= 2 && std::string(argv[1]) == "--export-session")
+		return exportSessionHeadless(argc, argv);
+
 	// Prepare sample to work
 	sample.init("../nuitrack/data/nuitrack.config");
 
@@ -71,10 +330,15 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	glfwSwapInterval(0);
+	// The skeleton overlay is predicted to the time of each frame so render at display refresh
+	glfwSwapInterval(1);
 
 	std::cout << glGetString(GL_VERSION) << std::endl;
 
+	// Every program is linked before the first frame, from the binaries of the last run when possible
+	ShaderManager::init("shadercache");
+	ShaderManager::prewarm();
+
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO(); (void)io;
@@ -88,8 +352,37 @@ int main(int argc, char* argv[])
 	float jointColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	float pointSize = 10.0f;
 	float lineWidth = 4.0f;
+	bool filterSkeleton = true;
+	float filterMinCutoff = 1.0f;
+	float filterBeta = 5.0f;
+	float predictionMs = 33.0f;
+	bool usePixelBuffers = true;
+	int viewMode = RGB_MODE;
+	int segmentationMode = SEGMENTATION_OFF;
+	int privacyMode = PRIVACY_OFF;
+	int privacyBlurRadius = 16;
+	float depthMin = 500.0f;
+	float depthMax = 4500.0f;
+	float cloudYaw = 0.0f;
+	float cloudPitch = 0.0f;
+	float cloudDistance = 2000.0f;
+	float cloudPointSize = 2.0f;
+	bool showSkeletonView = false;
+	float skeletonViewYaw = 0.5f;
+	float skeletonViewPitch = 0.3f;
+	float skeletonViewDistance = 3000.0f;
+	bool showMotionTrails = false;
+	int trailPoseCount = 30;
+	int ghostCount = 3;
+	float syncToleranceMs = DEFAULT_SYNC_TOLERANCE / 1000.0f;
 
 	int recordDuration = 20; // In seconds
+	bool showHistory = false;
+	int keyframeCount = 8;
+	unsigned int angleMask = ENGINE_ALL_ANGLES;
+	AngleBenchmark angleBenchmark;
+	ExportTiming exportTiming;
+	bool hasAngleBenchmark = false;
 
 	// Start main loop
 	while (!glfwWindowShouldClose(window))
@@ -97,6 +390,10 @@ int main(int argc, char* argv[])
 		//std::thread::id this_id = std::this_thread::get_id();
 		//std::cout << "Main thread: " << this_id << std::endl;
 
+		// The stages of the last frame finish while the new frames are received,
+		// the interface below reads their results once they are done
+		bool update = sample.ingest();
+
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
@@ -108,11 +405,78 @@ int main(int argc, char* argv[])
 			ImGui::Begin("Debug Window");
 			ImGui::Checkbox("Override joint colour", &overrideJointColour);
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+			ImGui::Text("Shaders ready in %.1f ms, %d cached, %d compiled", ShaderManager::getPrewarmMs(), ShaderManager::getLoadedCount(), ShaderManager::getCompiledCount());
 			ImGui::SliderFloat("Joint size", &pointSize, 0.1f, 20.0f);
-			ImGui::SliderFloat("Line width", &lineWidth, 0.1f, 15.0f);
+			ImGui::SliderFloat("Line width", &lineWidth, 0.5f, 30.0f);
 			ImGui::ColorPicker3("Skeleton color picker", skeletonColor);
 			ImGui::ColorPicker3("Joint color picker", jointColor);
+			ImGui::Checkbox("Filter skeleton", &filterSkeleton);
+			ImGui::SliderFloat("Filter min cutoff (Hz)", &filterMinCutoff, 0.1f, 5.0f);
+			ImGui::SliderFloat("Filter beta", &filterBeta, 0.0f, 20.0f);
+			ImGui::SliderFloat("Prediction (ms)", &predictionMs, 0.0f, 100.0f);
+
+			const UploadTiming& upload = sample.getColorStreamer().getTiming();
+			ImGui::Combo("View", &viewMode, "Depth\0Color\0Point cloud\0");
+			if (viewMode == DEPTH_SEGMENT_MODE || viewMode == POINT_CLOUD_MODE)
+			{
+				ImGui::DragFloatRange2("Depth range (mm)", &depthMin, &depthMax, 10.0f, 0.0f, 10000.0f);
+			}
+			if (viewMode == POINT_CLOUD_MODE)
+			{
+				ImGui::SliderAngle("Yaw", &cloudYaw, -180.0f, 180.0f);
+				ImGui::SliderAngle("Pitch", &cloudPitch, -89.0f, 89.0f);
+				ImGui::SliderFloat("Distance (mm)", &cloudDistance, 500.0f, 6000.0f);
+				ImGui::SliderFloat("Point size", &cloudPointSize, 1.0f, 8.0f);
+			}
+			ImGui::Checkbox("Motion trails", &showMotionTrails);
+			if (showMotionTrails)
+			{
+				ImGui::SliderInt("Trail length (frames)", &trailPoseCount, 2, TRAIL_MAX_POSES);
+				ImGui::SliderInt("Ghost skeletons", &ghostCount, 0, TRAIL_MAX_GHOSTS);
+			}
+			ImGui::Checkbox("3D skeleton view", &showSkeletonView);
+			if (showSkeletonView)
+			{
+				ImGui::SliderAngle("View yaw", &skeletonViewYaw, -180.0f, 180.0f);
+				ImGui::SliderAngle("View pitch", &skeletonViewPitch, -89.0f, 89.0f);
+				ImGui::SliderFloat("View distance (mm)", &skeletonViewDistance, 1000.0f, 8000.0f);
+				ImGui::Text("3D view GPU %.3f ms", sample.getSkeletonViewGpuMs());
+			}
+			if (viewMode == RGB_MODE)
+			{
+				ImGui::Combo("Highlight users", &segmentationMode, "Off\0Tint\0Outline\0Dim background\0");
+			}
+			ImGui::Combo("Privacy", &privacyMode, "Off\0Blank background\0Blur background\0");
+			if (privacyMode == PRIVACY_BLUR)
+			{
+				ImGui::SliderInt("Blur radius", &privacyBlurRadius, 1, 64);
+			}
+			if (privacyMode != PRIVACY_OFF)
+			{
+				ImGui::Text("Privacy mask %.2f ms per frame", sample.getPrivacyFilter().getLastTime());
+			}
+			ImGui::Checkbox("Stream color through PBOs", &usePixelBuffers);
+			ImGui::Text("Color upload %dx%d: GPU %.3f ms, CPU %.3f ms", upload.width, upload.height, upload.gpuMs, upload.cpuMs);
+			ImGui::SliderFloat("Sync tolerance (ms)", &syncToleranceMs, 1.0f, 100.0f);
+			if (sample.isFrameBundleMatched())
+				ImGui::Text("Frames in sync, largest offset %.1f ms", sample.getFrameBundle().skew / 1000.0f);
+			else
+				ImGui::Text("Frames not in sync, showing the newest");
 			ImGui::End();
+
+			sample.getColorStreamer().setUsePixelBuffers(usePixelBuffers);
+			sample.getFrameSynchronizer().setTolerance((uint64_t)(syncToleranceMs * 1000.0f));
+			sample.setViewMode((ViewMode)viewMode);
+			sample.setSegmentationMode((SegmentationMode)segmentationMode);
+			sample.getPrivacyFilter().setMode((PrivacyMode)privacyMode);
+			sample.getPrivacyFilter().setBlurRadius(privacyBlurRadius);
+			sample.setPointCloudCamera(cloudYaw, cloudPitch, cloudDistance, cloudPointSize);
+			sample.setMotionTrails(showMotionTrails, trailPoseCount, ghostCount);
+			sample.setSkeletonView(showSkeletonView, skeletonViewYaw, skeletonViewPitch, skeletonViewDistance);
+			sample.setDepthRange(depthMin, (std::max)(depthMax, depthMin + 1.0f));
+
+			sample.setSkeletonFiltering(filterSkeleton);
+			sample.setSkeletonFilterParameters(filterMinCutoff, filterBeta, predictionMs / 1000.0f);
 		}
 
 		{
@@ -136,18 +500,162 @@ int main(int argc, char* argv[])
 			{
 				sample.playLoadedData();
 			}
+
+			if (ImGui::Button("Play and record session"))
+			{
+				sample.startSession();
+			}
+
+			// The last session against the trainer it was played with, blocks the window until done,
+			// the export runs faster than the session took
+			if (ImGui::Button("Export session video"))
+			{
+				// Only exists for the export, its worker threads end with it
+				SessionExporter exporter;
+				exporter.exportSession(sample.getSessionFrames(), sample.getLoadedData(), "session.avi", outputMode.xres, outputMode.yres);
+				exportTiming = exporter.getTiming();
+			}
+			if (exportTiming.frames > 0)
+			{
+				ImGui::Text("Exported %d frames in %.1f s (%.1fx real time)", exportTiming.frames, exportTiming.seconds,
+					exportTiming.sessionSeconds / (std::max)(exportTiming.seconds, 0.001f));
+			}
 			ImGui::End();
 		}
 
 
+		{
+			ImGui::Begin("Range of Motion");
+			ImGui::Checkbox("Show history", &showHistory);
+			if (ImGui::Button("Add to history"))
+			{
+				sample.addStatisticsToHistory();
+			}
+			showAngleStatistics(showHistory ? sample.getHistoryStatistics() : sample.getAngleStatistics());
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Angles");
+			ImGui::Text("Angles used by the exercise");
+			if (ImGui::Button("All"))
+				angleMask = ENGINE_ALL_ANGLES;
+			ImGui::SameLine();
+			if (ImGui::Button("None"))
+				angleMask = 0;
+			for (int i = 0; i < ENGINE_ANGLE_COUNT; i++)
+			{
+				ImGui::CheckboxFlags(AngleStatistics::getAngleName(i), &angleMask, 1u << i);
+			}
+			sample.setScoringMask(angleMask);
+
+			ImGui::Separator();
+			if (ImGui::Button("Benchmark"))
+			{
+				angleBenchmark = AngleEngine::benchmark(100000);
+				hasAngleBenchmark = true;
+				std::cout << "Angle engine: scalar " << angleBenchmark.scalarNs << " ns, SIMD " << angleBenchmark.simdNs << " ns per skeleton" << std::endl;
+			}
+			if (hasAngleBenchmark)
+			{
+				ImGui::Text("Scalar: %.0f ns per skeleton", angleBenchmark.scalarNs);
+				ImGui::Text("SIMD: %.0f ns per skeleton (%.1fx)", angleBenchmark.simdNs, angleBenchmark.scalarNs / angleBenchmark.simdNs);
+				ImGui::Text("Max atan2 error: %.5f degrees", angleBenchmark.maxError);
+				ImGui::Text("Rounded mismatches: %d of %d", angleBenchmark.mismatches, angleBenchmark.samples * ENGINE_ANGLE_COUNT);
+			}
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Anatomical Angles");
+			ImGui::Text("Flexion / abduction / rotation in degrees");
+			showAnatomicalAngles(sample.getLastUserFrame(), sample.getReplayFrame());
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Users");
+			showUsers(sample);
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Symmetry");
+			showSymmetry(sample.getSymmetryAnalyzer());
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Balance");
+			const BalanceReport& balance = sample.getBalanceEstimator().getReport();
+			if (balance.valid)
+			{
+				ImGui::Text("Center of mass height: %.0f mm", balance.height);
+				ImGui::Text("Offset from ankles: %.0f mm side, %.0f mm forward", balance.offset[0], balance.offset[1]);
+				ImGui::Text("Sway velocity: %.1f mm/s", balance.swayVelocity);
+				ImGui::Text("Path length: %.0f mm", balance.pathLength);
+			}
+			else
+			{
+				ImGui::Text("Full body not tracked");
+			}
+			if (ImGui::Button("Reset"))
+			{
+				sample.getBalanceEstimator().clear();
+			}
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Smoothness");
+			ImGui::Text("Live");
+			showSmoothness(sample.getSmoothnessAnalyzer().getReports());
+			if (ImGui::Button("Analyze loaded data"))
+			{
+				sample.analyzeLoadedData();
+			}
+			showSmoothness(sample.getLoadedDataSmoothness());
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Keyframes");
+			ImGui::SliderInt("Keyframe count", &keyframeCount, 2, 16);
+			if (ImGui::Button("Extract keyframes"))
+			{
+				sample.extractKeyframes(keyframeCount);
+			}
+
+			const std::vector<Keyframe>& keyframes = sample.getKeyframes();
+			const std::vector<JointFrame>& loadedData = sample.getLoadedData();
+			for (int i = 0; i < (int)keyframes.size(); i++)
+			{
+				if (i % 4 != 0)
+					ImGui::SameLine();
+
+				ImGui::BeginGroup();
+				ImGui::PushID(i);
+				drawSkeletonThumbnail(loadedData[keyframes[i].frame], 80.0f, i == sample.getClosestKeyframe());
+				if (ImGui::SmallButton("Preview"))
+				{
+					sample.previewKeyframe(i);
+				}
+				ImGui::PopID();
+				ImGui::EndGroup();
+			}
+			ImGui::End();
+		}
+
 		// Delegate this action to example's main class
-		bool update = sample.update(skeletonColor, jointColor, pointSize, lineWidth, overrideJointColour);
+		if (update)
+			update = sample.update(skeletonColor, jointColor, pointSize, lineWidth, overrideJointColour);
 
 		if (!update)
 		{
 			// End the work if update failed
 			std::cout << "Sample failed to update, ending program" << std::endl;
 			sample.release();
+			ShaderManager::release();
 			glfwTerminate();
 			exit(EXIT_FAILURE);
 		}
@@ -161,6 +669,7 @@ int main(int argc, char* argv[])
 	}
 
 	sample.release();
+	ShaderManager::release();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 	glfwTerminate();
@@ -0,0 +1,187 @@
+#include "AviWriter.h"
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+// Positions of the fields close() fills in, they follow from the fixed size headers
+#define RIFF_SIZE_OFFSET 4
+#define TOTAL_FRAMES_OFFSET 48
+#define MAIN_BUFFER_SIZE_OFFSET 60
+#define STREAM_LENGTH_OFFSET 140
+#define STREAM_BUFFER_SIZE_OFFSET 144
+#define MOVI_SIZE_OFFSET 216
+
+#define AVIF_HASINDEX 0x10
+#define AVIIF_KEYFRAME 0x10
+
+static void writeU32(std::ofstream& file, uint32_t value)
+{
+	// AVI is little endian like every platform the application runs on
+	file.write((const char*)&value, 4);
+}
+
+static void writeU16(std::ofstream& file, uint16_t value)
+{
+	file.write((const char*)&value, 2);
+}
+
+static void writeFourCC(std::ofstream& file, const char* fourCC)
+{
+	file.write(fourCC, 4);
+}
+
+static void patchU32(std::ofstream& file, std::streamoff offset, uint32_t value)
+{
+	file.seekp(offset);
+	writeU32(file, value);
+}
+
+AviWriter::AviWriter() :
+	largestFrame(0),
+	moviStart(0)
+{
+}
+
+AviWriter::~AviWriter()
+{
+	close();
+}
+
+bool AviWriter::open(const std::string& path, int width, int height, float framesPerSecond)
+{
+	close();
+
+	file.open(path, std::ofstream::binary | std::ofstream::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open " << path << " for writing" << std::endl;
+		return false;
+	}
+
+	index.clear();
+	largestFrame = 0;
+	writeHeaders(width, height, framesPerSecond);
+	return true;
+}
+
+void AviWriter::writeHeaders(int width, int height, float framesPerSecond)
+{
+	// The rate is a fraction, a thousandth of a frame is precise enough
+	uint32_t scale = 1000;
+	uint32_t rate = (uint32_t)std::lround(framesPerSecond * scale);
+
+	writeFourCC(file, "RIFF");
+	writeU32(file, 0);
+	writeFourCC(file, "AVI ");
+
+	writeFourCC(file, "LIST");
+	writeU32(file, 192);
+	writeFourCC(file, "hdrl");
+
+	writeFourCC(file, "avih");
+	writeU32(file, 56);
+	writeU32(file, (uint32_t)std::lround(1000000.0f / framesPerSecond));
+	writeU32(file, 0); // Max bytes per second
+	writeU32(file, 0); // Padding granularity
+	writeU32(file, AVIF_HASINDEX);
+	writeU32(file, 0); // Total frames
+	writeU32(file, 0); // Initial frames
+	writeU32(file, 1); // Streams
+	writeU32(file, 0); // Suggested buffer size
+	writeU32(file, width);
+	writeU32(file, height);
+	for (int i = 0; i < 4; i++)
+		writeU32(file, 0);
+
+	writeFourCC(file, "LIST");
+	writeU32(file, 116);
+	writeFourCC(file, "strl");
+
+	writeFourCC(file, "strh");
+	writeU32(file, 56);
+	writeFourCC(file, "vids");
+	writeFourCC(file, "MJPG");
+	writeU32(file, 0); // Flags
+	writeU16(file, 0); // Priority
+	writeU16(file, 0); // Language
+	writeU32(file, 0); // Initial frames
+	writeU32(file, scale);
+	writeU32(file, rate);
+	writeU32(file, 0); // Start
+	writeU32(file, 0); // Length
+	writeU32(file, 0); // Suggested buffer size
+	writeU32(file, 0xFFFFFFFF); // Default quality
+	writeU32(file, 0); // Sample size, frames vary
+	writeU16(file, 0);
+	writeU16(file, 0);
+	writeU16(file, (uint16_t)width);
+	writeU16(file, (uint16_t)height);
+
+	// BITMAPINFOHEADER
+	writeFourCC(file, "strf");
+	writeU32(file, 40);
+	writeU32(file, 40);
+	writeU32(file, width);
+	writeU32(file, height);
+	writeU16(file, 1); // Planes
+	writeU16(file, 24); // Bits per pixel once decoded
+	writeFourCC(file, "MJPG");
+	writeU32(file, width * height * 3);
+	for (int i = 0; i < 4; i++)
+		writeU32(file, 0);
+
+	writeFourCC(file, "LIST");
+	writeU32(file, 0);
+	moviStart = file.tellp();
+	writeFourCC(file, "movi");
+}
+
+void AviWriter::addFrame(const std::vector<uint8_t>& jpeg)
+{
+	if (!file.is_open())
+		return;
+
+	IndexEntry entry;
+	entry.offset = (uint32_t)(file.tellp() - moviStart);
+	entry.size = (uint32_t)jpeg.size();
+	index.push_back(entry);
+	largestFrame = (std::max)(largestFrame, entry.size);
+
+	writeFourCC(file, "00dc");
+	writeU32(file, entry.size);
+	file.write((const char*)jpeg.data(), jpeg.size());
+
+	// Chunks start on even offsets
+	if (jpeg.size() & 1)
+		file.put(0);
+}
+
+void AviWriter::close()
+{
+	if (!file.is_open())
+		return;
+
+	std::streampos indexStart = file.tellp();
+
+	writeFourCC(file, "idx1");
+	writeU32(file, (uint32_t)index.size() * 16);
+	for (const IndexEntry& entry : index)
+	{
+		writeFourCC(file, "00dc");
+		writeU32(file, AVIIF_KEYFRAME);
+		writeU32(file, entry.offset);
+		writeU32(file, entry.size);
+	}
+
+	std::streampos end = file.tellp();
+
+	patchU32(file, RIFF_SIZE_OFFSET, (uint32_t)end - 8);
+	patchU32(file, TOTAL_FRAMES_OFFSET, (uint32_t)index.size());
+	patchU32(file, MAIN_BUFFER_SIZE_OFFSET, largestFrame + 8);
+	patchU32(file, STREAM_LENGTH_OFFSET, (uint32_t)index.size());
+	patchU32(file, STREAM_BUFFER_SIZE_OFFSET, largestFrame + 8);
+	patchU32(file, MOVI_SIZE_OFFSET, (uint32_t)(indexStart - moviStart));
+
+	file.close();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Writes a Motion JPEG AVI, a single video stream of JPEG frames that every common player reads.
+// Frames are appended as they come, the header sizes and the index are written by close().
+class AviWriter final
+{
+public:
+	AviWriter();
+	~AviWriter();
+
+	bool open(const std::string& path, int width, int height, float framesPerSecond);
+	void addFrame(const std::vector<uint8_t>& jpeg);
+	void close();
+
+	bool isOpen() const { return file.is_open(); }
+	int getFrameCount() const { return (int)index.size(); }
+
+private:
+	struct IndexEntry
+	{
+		uint32_t offset; // From the movi list type
+		uint32_t size;
+	};
+
+	std::ofstream file;
+	std::vector<IndexEntry> index;
+	uint32_t largestFrame;
+	std::streampos moviStart;
+
+	void writeHeaders(int width, int height, float framesPerSecond);
+};
@@ -0,0 +1,161 @@
+#include "BalanceEstimator.h"
+#include "NuitrackGL.h"
+
+#include <cmath>
+#include <cstring>
+
+#define SEGMENT_COUNT 14
+#define CONFIDENCE_THRESHOLD 0.15f
+#define VELOCITY_SMOOTHING 0.2f
+
+struct Segment
+{
+	int proximal;
+	int distal;
+	float mass; // Fraction of the total body mass
+	float com; // Position of the segment center of mass from the proximal joint, as a fraction of the segment length
+};
+
+static const Segment segments[SEGMENT_COUNT] = {
+	{ tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_HEAD, 0.081f, 1.0f },
+	{ tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_WAIST, 0.497f, 0.5f },
+	{ tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW, 0.028f, 0.436f },
+	{ tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW, 0.028f, 0.436f },
+	{ tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST, 0.016f, 0.430f },
+	{ tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST, 0.016f, 0.430f },
+	{ tdv::nuitrack::JOINT_LEFT_WRIST, tdv::nuitrack::JOINT_LEFT_HAND, 0.006f, 0.506f },
+	{ tdv::nuitrack::JOINT_RIGHT_WRIST, tdv::nuitrack::JOINT_RIGHT_HAND, 0.006f, 0.506f },
+	{ tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_LEFT_KNEE, 0.100f, 0.433f },
+	{ tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_RIGHT_KNEE, 0.100f, 0.433f },
+	{ tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_ANKLE, 0.0465f, 0.433f },
+	{ tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_ANKLE, 0.0465f, 0.433f },
+	// Feet are not tracked, their mass is put on the ankles
+	{ tdv::nuitrack::JOINT_LEFT_ANKLE, tdv::nuitrack::JOINT_LEFT_ANKLE, 0.0145f, 0.0f },
+	{ tdv::nuitrack::JOINT_RIGHT_ANKLE, tdv::nuitrack::JOINT_RIGHT_ANKLE, 0.0145f, 0.0f }
+};
+
+static float dot(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+BalanceEstimator::BalanceEstimator()
+{
+	// Until the UserTracker reports a floor assume the camera is level and the floor is at y = 0
+	setFloor(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
+	clear();
+}
+
+void BalanceEstimator::setFloor(float pointX, float pointY, float pointZ, float normalX, float normalY, float normalZ)
+{
+	float length = sqrt(normalX * normalX + normalY * normalY + normalZ * normalZ);
+
+	// The UserTracker reports a zero normal until it has found the floor
+	if (length < 1e-6f)
+		return;
+
+	floorPoint[0] = pointX;
+	floorPoint[1] = pointY;
+	floorPoint[2] = pointZ;
+
+	floorNormal[0] = normalX / length;
+	floorNormal[1] = normalY / length;
+	floorNormal[2] = normalZ / length;
+
+	// Project the camera x axis on the floor to get the side to side axis
+	floorAxisX[0] = 1.0f - floorNormal[0] * floorNormal[0];
+	floorAxisX[1] = -floorNormal[0] * floorNormal[1];
+	floorAxisX[2] = -floorNormal[0] * floorNormal[2];
+
+	length = sqrt(dot(floorAxisX, floorAxisX));
+	floorAxisX[0] /= length;
+	floorAxisX[1] /= length;
+	floorAxisX[2] /= length;
+
+	// Forward and backward axis, pointing away from the camera
+	floorAxisZ[0] = floorAxisX[1] * floorNormal[2] - floorAxisX[2] * floorNormal[1];
+	floorAxisZ[1] = floorAxisX[2] * floorNormal[0] - floorAxisX[0] * floorNormal[2];
+	floorAxisZ[2] = floorAxisX[0] * floorNormal[1] - floorAxisX[1] * floorNormal[0];
+}
+
+void BalanceEstimator::clear()
+{
+	memset(&report, 0, sizeof(report));
+	lastTime = 0;
+}
+
+void BalanceEstimator::update(const JointFrame& frame, double time)
+{
+	float com[3] = { 0.0f, 0.0f, 0.0f };
+	float totalMass = 0.0f;
+
+	for (int i = 0; i < SEGMENT_COUNT; i++)
+	{
+		const Segment& segment = segments[i];
+
+		// Skip segments that are not tracked, the rest of the body is renormalized below
+		if (frame.confidence[segment.proximal] < CONFIDENCE_THRESHOLD || frame.confidence[segment.distal] < CONFIDENCE_THRESHOLD)
+			continue;
+
+		const Vector3& a = frame.realJoints[segment.proximal];
+		const Vector3& b = frame.realJoints[segment.distal];
+
+		com[0] += segment.mass * (a.x + segment.com * (b.x - a.x));
+		com[1] += segment.mass * (a.y + segment.com * (b.y - a.y));
+		com[2] += segment.mass * (a.z + segment.com * (b.z - a.z));
+		totalMass += segment.mass;
+	}
+
+	// Without the trunk the estimate is meaningless
+	if (totalMass < 0.5f)
+	{
+		report.valid = false;
+		return;
+	}
+
+	com[0] /= totalMass;
+	com[1] /= totalMass;
+	com[2] /= totalMass;
+
+	// Support base is taken as the middle of the ankles
+	if (frame.confidence[tdv::nuitrack::JOINT_LEFT_ANKLE] < CONFIDENCE_THRESHOLD || frame.confidence[tdv::nuitrack::JOINT_RIGHT_ANKLE] < CONFIDENCE_THRESHOLD)
+	{
+		report.valid = false;
+		return;
+	}
+
+	const Vector3& leftAnkle = frame.realJoints[tdv::nuitrack::JOINT_LEFT_ANKLE];
+	const Vector3& rightAnkle = frame.realJoints[tdv::nuitrack::JOINT_RIGHT_ANKLE];
+	float base[3] = {
+		(leftAnkle.x + rightAnkle.x) * 0.5f - com[0],
+		(leftAnkle.y + rightAnkle.y) * 0.5f - com[1],
+		(leftAnkle.z + rightAnkle.z) * 0.5f - com[2]
+	};
+	float fromFloor[3] = { com[0] - floorPoint[0], com[1] - floorPoint[1], com[2] - floorPoint[2] };
+
+	// Only the in-plane components are kept, which is the projection on the floor
+	float position[2] = { -dot(base, floorAxisX), -dot(base, floorAxisZ) };
+
+	if (report.valid && time > lastTime)
+	{
+		float dx = position[0] - lastPosition[0];
+		float dz = position[1] - lastPosition[1];
+		float distance = sqrt(dx * dx + dz * dz);
+
+		report.pathLength += distance;
+		report.swayVelocity += VELOCITY_SMOOTHING * ((float)(distance / (time - lastTime)) - report.swayVelocity);
+	}
+
+	report.valid = true;
+	report.com[0] = com[0];
+	report.com[1] = com[1];
+	report.com[2] = com[2];
+	report.height = dot(fromFloor, floorNormal);
+	report.offset[0] = position[0];
+	report.offset[1] = position[1];
+	report.frames++;
+
+	lastPosition[0] = position[0];
+	lastPosition[1] = position[1];
+	lastTime = time;
+}
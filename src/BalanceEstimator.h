@@ -0,0 +1,45 @@
+#pragma once
+
+struct JointFrame;
+
+struct BalanceReport
+{
+	bool valid;
+	float com[3]; // Center of mass in real world coordinates (mm)
+	float height; // Height of the center of mass above the floor (mm)
+	float offset[2]; // Center of mass projected on the floor, relative to the middle of the ankles (mm)
+	float swayVelocity; // mm/s
+	float pathLength; // Distance travelled by the projected center of mass since the last reset (mm)
+	int frames;
+};
+
+// Segmental center of mass estimate from real world joint positions, using the
+// anthropometric segment masses from Winter's "Biomechanics and Motor Control of Human Movement".
+// The center of mass is projected on the floor plane reported by the UserTracker to get sway metrics.
+// update() works on fixed tables only and never allocates.
+class BalanceEstimator
+{
+public:
+	BalanceEstimator();
+
+	// Floor point and normal in real world coordinates, as given by UserFrame::getFloor()/getFloorNormal()
+	void setFloor(float pointX, float pointY, float pointZ, float normalX, float normalY, float normalZ);
+
+	// time is in seconds
+	void update(const JointFrame& frame, double time);
+	void clear();
+
+	const BalanceReport& getReport() const { return report; }
+
+private:
+	float floorPoint[3];
+	float floorNormal[3];
+	// Axes of the floor plane
+	float floorAxisX[3];
+	float floorAxisZ[3];
+
+	float lastPosition[2];
+	double lastTime;
+
+	BalanceReport report;
+};
@@ -0,0 +1,95 @@
+#include "CameraMath.h"
+
+#include <cmath>
+
+namespace CameraMath
+{
+	Matrix4 identity()
+	{
+		Matrix4 result = { { 0 } };
+		result.m[0] = result.m[5] = result.m[10] = result.m[15] = 1.0f;
+		return result;
+	}
+
+	Matrix4 multiply(const Matrix4& a, const Matrix4& b)
+	{
+		Matrix4 result;
+		for (int column = 0; column < 4; column++)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < 4; k++)
+					sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+				result.m[column * 4 + row] = sum;
+			}
+		}
+		return result;
+	}
+
+	Matrix4 translation(float x, float y, float z)
+	{
+		Matrix4 result = identity();
+		result.m[12] = x;
+		result.m[13] = y;
+		result.m[14] = z;
+		return result;
+	}
+
+	Matrix4 rotationX(float radians)
+	{
+		Matrix4 result = identity();
+		float c = std::cos(radians);
+		float s = std::sin(radians);
+		result.m[5] = c;
+		result.m[6] = s;
+		result.m[9] = -s;
+		result.m[10] = c;
+		return result;
+	}
+
+	Matrix4 rotationY(float radians)
+	{
+		Matrix4 result = identity();
+		float c = std::cos(radians);
+		float s = std::sin(radians);
+		result.m[0] = c;
+		result.m[2] = -s;
+		result.m[8] = s;
+		result.m[10] = c;
+		return result;
+	}
+
+	Matrix4 scale(float x, float y, float z)
+	{
+		Matrix4 result = identity();
+		result.m[0] = x;
+		result.m[5] = y;
+		result.m[10] = z;
+		return result;
+	}
+
+	Matrix4 perspective(float fovY, float aspect, float zNear, float zFar)
+	{
+		Matrix4 result = { { 0 } };
+		float f = 1.0f / std::tan(fovY * 0.5f);
+		result.m[0] = f / aspect;
+		result.m[5] = f;
+		result.m[10] = (zFar + zNear) / (zNear - zFar);
+		result.m[11] = -1.0f;
+		result.m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+		return result;
+	}
+
+	Matrix4 orbit(float targetX, float targetY, float targetZ, float yaw, float pitch, float distance)
+	{
+		// Nuitrack looks down +z with x to the right, OpenGL looks down -z.
+		// Negating x as well mirrors the scene like the color view.
+		Matrix4 toGL = scale(-1.0f, 1.0f, -1.0f);
+		Matrix4 view = translation(0.0f, 0.0f, -distance);
+		view = multiply(view, rotationX(pitch));
+		view = multiply(view, rotationY(yaw));
+		view = multiply(view, toGL);
+		return multiply(view, translation(-targetX, -targetY, -targetZ));
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Column major 4x4 matrix, as OpenGL expects it
+struct Matrix4
+{
+	float m[16];
+};
+
+// Small set of transforms for the 3D views
+namespace CameraMath
+{
+	Matrix4 identity();
+	Matrix4 multiply(const Matrix4& a, const Matrix4& b);
+	Matrix4 translation(float x, float y, float z);
+	Matrix4 rotationX(float radians);
+	Matrix4 rotationY(float radians);
+	Matrix4 scale(float x, float y, float z);
+	// fovY in radians
+	Matrix4 perspective(float fovY, float aspect, float zNear, float zFar);
+
+	// Camera orbiting around a target in Nuitrack real world coordinates (mm, z away from the sensor).
+	// The view is mirrored like the color image, yaw and pitch in radians, distance in mm.
+	Matrix4 orbit(float targetX, float targetY, float targetZ, float yaw, float pitch, float distance);
+}
@@ -1,5 +1,6 @@
 #include "DiskHelper.h"
 #include <fstream>
+#include <sstream>
 
 DiskHelper::DiskHelper()
 {
@@ -25,121 +26,11 @@ void DiskHelper::readDatafromDisk(const std::string& path, std::vector<JointFram
 
 	while (std::getline(file, line))
 	{
-		JointFrame jointFrame;
+		// Older recordings have no anatomical angles, those stay 0
+		JointFrame jointFrame = {};
 
-		bool checkType = true;
-
-		bool time = false;
-		bool type = false;
-		bool confidence = false;
-		bool x = false;
-		bool y = false;
-		bool angle = false;
-
-		unsigned int p1 = 0;
-		unsigned int p2 = 0;
-
-		uint8_t index = 0;
-		uint8_t index2 = 0;
-
-		while (p2 < line.size())
-		{
-			if (checkType)
-			{
-				while (line.at(p2) != ',')
-				{
-					p2++;
-				}
-
-				std::string typeString = line.substr(p1, p2 - p1);
-
-				if (typeString.compare("Time") == 0)
-				{
-					time = true;
-				}
-				else if (typeString.compare("Type") == 0)
-				{
-					type = true;
-				}
-				else if (typeString.compare("Confidence") == 0)
-				{
-					confidence = true;
-				}
-				else if (typeString.compare("x") == 0)
-				{
-					x = true;
-				}
-				else if (typeString.compare("y") == 0)
-				{
-					y = true;
-				}
-				else if (typeString.compare("Angle") == 0)
-				{
-					angle = true;
-				}
-				else {
-					std::cout << "Error when trying to read file" << std::endl;
-					return;
-				}
-
-				p2 = p2 + 1;
-				p1 = p2;
-
-				checkType = false;
-
-			}
-			else
-			{
-				while (line.at(p2) != ',')
-				{
-					p2++;
-				}
-
-				std::string dataString = line.substr(p1, p2 - p1);
-
-				if (time)
-				{
-					time = false;
-					jointFrame.timeStamp = std::stoi(dataString);
-				}
-				else if (type)
-				{
-					type = false;
-					// Ignore type
-				}
-				else if (confidence)
-				{
-					confidence = false;
-					jointFrame.confidence[index] = std::stof(dataString);
-				}
-				else if (x)
-				{
-					x = false;
-					jointFrame.joints[index].x = std::stof(dataString);
-				}
-				else if (y)
-				{
-					y = false;
-					jointFrame.joints[index].y = std::stof(dataString);
-					index++;
-				}
-				else if (angle)
-				{
-					angle = false;
-					jointFrame.angles[index2] = std::stoi(dataString);
-					index2++;
-				}
-				else {
-					std::cout << "Error when trying to read file" << std::endl;
-					return;
-				}
-
-				p2 = p2 + 1;
-				p1 = p2;
-
-				checkType = true;
-			}
-		}
+		if (!readJointFrame(line, jointFrame, NULL))
+			return;
 
 		buffer.push_back(jointFrame);
 	}
@@ -158,14 +49,408 @@ void DiskHelper::writeDataToDisk(const std::string& path, const std::vector<Join
 	std::ofstream file(path, std::ofstream::trunc);
 	for (int j = 0; j < buffer.size(); j++)
 	{
-		file << "Time," << buffer[j].timeStamp << ",";
-		for (int i = 0; i < 25; i++)
-			file << "Type," << i << ",Confidence," << buffer[j].confidence[i] << ",x," << buffer[j].joints[i].x << ",y," << buffer[j].joints[i].y << ",";
-		
-		for (int i = 0; i < 19; i++)
-			file << "Angle," << buffer[j].angles[i] << ",";
+		writeJointFrame(file, buffer[j]);
+		file << std::endl;
+	}
+	file.close();
+}
+
+void DiskHelper::readSessionFromDisk(const std::string& path, std::vector<SessionFrame>& buffer)
+{
+	std::ifstream file(path);
+
+	if (!file.is_open())
+	{
+		std::cout << "Cannot open file" << std::endl;
+		return;
+	}
+
+	std::string line;
+
+	buffer.clear();
+
+	while (std::getline(file, line))
+	{
+		SessionFrame sessionFrame = {};
+
+		if (!readJointFrame(line, sessionFrame.patient, &sessionFrame))
+			return;
+
+		buffer.push_back(sessionFrame);
+	}
+
+	std::cout << "Session read into memory" << std::endl;
+}
+
+void DiskHelper::writeSessionToDisk(const std::string& path, const std::vector<SessionFrame>& buffer)
+{
+	std::ofstream file(path, std::ofstream::trunc);
+	for (size_t j = 0; j < buffer.size(); j++)
+	{
+		writeJointFrame(file, buffer[j].patient);
+		file << "Trainer," << buffer[j].trainerFrame << ",Cost," << buffer[j].alignmentCost << ",Score," << (int)buffer[j].score << ",";
+		file << std::endl;
+	}
+	file.close();
+}
+
+// One line per angle: "Angle,index,Min,value,Max,value," followed by a "Mean,value,Weight,value," pair per centroid
+void DiskHelper::readStatisticsFromDisk(const std::string& path, AngleStatistics& statistics)
+{
+	statistics.clear();
+
+	// Nothing has been saved yet, like the history before the first session is added
+	std::ifstream file(path);
+	if (!file.is_open())
+		return;
+
+	std::string line;
+	std::vector<Centroid> centroids;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string typeString;
+		std::string dataString;
+
+		int angle = -1;
+		float min = 0;
+		float max = 0;
+		Centroid centroid = { 0, 0 };
+
+		centroids.clear();
+
+		while (std::getline(stream, typeString, ',') && std::getline(stream, dataString, ','))
+		{
+			if (typeString.compare("Angle") == 0)
+			{
+				angle = std::stoi(dataString);
+			}
+			else if (typeString.compare("Min") == 0)
+			{
+				min = std::stof(dataString);
+			}
+			else if (typeString.compare("Max") == 0)
+			{
+				max = std::stof(dataString);
+			}
+			else if (typeString.compare("Mean") == 0)
+			{
+				centroid.mean = std::stof(dataString);
+			}
+			else if (typeString.compare("Weight") == 0)
+			{
+				centroid.weight = std::stof(dataString);
+				centroids.push_back(centroid);
+			}
+			else {
+				std::cout << "Error when trying to read file" << std::endl;
+				return;
+			}
+		}
+
+		if (angle < 0 || angle >= AngleStatistics::ANGLE_COUNT)
+		{
+			std::cout << "Error when trying to read file" << std::endl;
+			return;
+		}
+
+		if (!centroids.empty())
+			statistics.getDigest(angle).load(centroids, min, max);
+	}
+
+	std::cout << "Statistics read into memory" << std::endl;
+}
+
+void DiskHelper::writeStatisticsToDisk(const std::string& path, AngleStatistics& statistics)
+{
+	std::ofstream file(path, std::ofstream::trunc);
+	for (int j = 0; j < AngleStatistics::ANGLE_COUNT; j++)
+	{
+		TDigest& digest = statistics.getDigest(j);
+		const std::vector<Centroid>& centroids = digest.getCentroids();
+
+		file << "Angle," << j << ",Min," << digest.getMin() << ",Max," << digest.getMax() << ",";
+		for (size_t i = 0; i < centroids.size(); i++)
+			file << "Mean," << centroids[i].mean << ",Weight," << centroids[i].weight << ",";
 
 		file << std::endl;
 	}
 	file.close();
 }
+
+// One line per keyframe: "Frame,index,Size,count,"
+void DiskHelper::readKeyframesFromDisk(const std::string& path, std::vector<Keyframe>& keyframes)
+{
+	keyframes.clear();
+
+	// Recordings have no keyframes until they are extracted
+	std::ifstream file(path);
+	if (!file.is_open())
+		return;
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string typeString;
+		std::string dataString;
+
+		Keyframe keyframe = { -1, 0 };
+
+		while (std::getline(stream, typeString, ',') && std::getline(stream, dataString, ','))
+		{
+			if (typeString.compare("Frame") == 0)
+			{
+				keyframe.frame = std::stoi(dataString);
+			}
+			else if (typeString.compare("Size") == 0)
+			{
+				keyframe.clusterSize = std::stoi(dataString);
+			}
+			else {
+				std::cout << "Error when trying to read file" << std::endl;
+				keyframes.clear();
+				return;
+			}
+		}
+
+		if (keyframe.frame >= 0)
+			keyframes.push_back(keyframe);
+	}
+
+	std::cout << "Keyframes read into memory" << std::endl;
+}
+
+void DiskHelper::writeKeyframesToDisk(const std::string& path, const std::vector<Keyframe>& keyframes)
+{
+	std::ofstream file(path, std::ofstream::trunc);
+	for (size_t i = 0; i < keyframes.size(); i++)
+		file << "Frame," << keyframes[i].frame << ",Size," << keyframes[i].clusterSize << "," << std::endl;
+	file.close();
+}
+
+bool DiskHelper::readJointFrame(const std::string& line, JointFrame& jointFrame, SessionFrame* sessionFrame)
+{
+	bool checkType = true;
+
+	bool time = false;
+	bool sensor = false;
+	bool type = false;
+	bool confidence = false;
+	bool x = false;
+	bool y = false;
+	bool realX = false;
+	bool realY = false;
+	bool realZ = false;
+	bool angle = false;
+	bool anatomical = false;
+	bool trainer = false;
+	bool cost = false;
+	bool score = false;
+
+	unsigned int p1 = 0;
+	unsigned int p2 = 0;
+
+	uint8_t index = 0;
+	uint8_t index2 = 0;
+	uint8_t index3 = 0;
+
+	while (p2 < line.size())
+	{
+		if (checkType)
+		{
+			while (line.at(p2) != ',')
+			{
+				p2++;
+			}
+
+			std::string typeString = line.substr(p1, p2 - p1);
+
+			if (typeString.compare("Time") == 0)
+			{
+				time = true;
+			}
+			else if (typeString.compare("Sensor") == 0)
+			{
+				sensor = true;
+			}
+			else if (typeString.compare("Type") == 0)
+			{
+				type = true;
+			}
+			else if (typeString.compare("Confidence") == 0)
+			{
+				confidence = true;
+			}
+			else if (typeString.compare("x") == 0)
+			{
+				x = true;
+			}
+			else if (typeString.compare("y") == 0)
+			{
+				y = true;
+			}
+			else if (typeString.compare("rx") == 0)
+			{
+				realX = true;
+			}
+			else if (typeString.compare("ry") == 0)
+			{
+				realY = true;
+			}
+			else if (typeString.compare("rz") == 0)
+			{
+				realZ = true;
+			}
+			else if (typeString.compare("Angle") == 0)
+			{
+				angle = true;
+			}
+			else if (typeString.compare("Anatomical") == 0)
+			{
+				anatomical = true;
+			}
+			else if (sessionFrame && typeString.compare("Trainer") == 0)
+			{
+				trainer = true;
+			}
+			else if (sessionFrame && typeString.compare("Cost") == 0)
+			{
+				cost = true;
+			}
+			else if (sessionFrame && typeString.compare("Score") == 0)
+			{
+				score = true;
+			}
+			else {
+				std::cout << "Error when trying to read file" << std::endl;
+				return false;
+			}
+
+			p2 = p2 + 1;
+			p1 = p2;
+
+			checkType = false;
+
+		}
+		else
+		{
+			while (line.at(p2) != ',')
+			{
+				p2++;
+			}
+
+			std::string dataString = line.substr(p1, p2 - p1);
+
+			if (time)
+			{
+				time = false;
+				jointFrame.timeStamp = std::stoi(dataString);
+			}
+			else if (sensor)
+			{
+				sensor = false;
+				jointFrame.sensorTimestamp = std::stoull(dataString);
+			}
+			else if (type)
+			{
+				type = false;
+				// Ignore type
+			}
+			else if (confidence)
+			{
+				confidence = false;
+				jointFrame.confidence[index] = std::stof(dataString);
+			}
+			else if (x)
+			{
+				x = false;
+				jointFrame.joints[index].x = std::stof(dataString);
+			}
+			else if (y)
+			{
+				y = false;
+				jointFrame.joints[index].y = std::stof(dataString);
+				index++;
+			}
+			// Real world coordinates follow the joint they belong to, older files do not have them
+			else if (realX)
+			{
+				realX = false;
+				if (index > 0)
+					jointFrame.realJoints[index - 1].x = std::stof(dataString);
+			}
+			else if (realY)
+			{
+				realY = false;
+				if (index > 0)
+					jointFrame.realJoints[index - 1].y = std::stof(dataString);
+			}
+			else if (realZ)
+			{
+				realZ = false;
+				if (index > 0)
+					jointFrame.realJoints[index - 1].z = std::stof(dataString);
+			}
+			else if (angle)
+			{
+				angle = false;
+				jointFrame.angles[index2] = std::stoi(dataString);
+				index2++;
+			}
+			else if (anatomical)
+			{
+				anatomical = false;
+				if (index3 < ANATOMICAL_JOINT_COUNT * ANATOMICAL_AXIS_COUNT)
+					jointFrame.anatomicalAngles[index3 / ANATOMICAL_AXIS_COUNT][index3 % ANATOMICAL_AXIS_COUNT] = std::stof(dataString);
+				index3++;
+			}
+			else if (trainer)
+			{
+				trainer = false;
+				sessionFrame->trainerFrame = (uint32_t)std::stoul(dataString);
+			}
+			else if (cost)
+			{
+				cost = false;
+				sessionFrame->alignmentCost = (uint16_t)std::stoi(dataString);
+			}
+			else if (score)
+			{
+				score = false;
+				sessionFrame->score = (uint8_t)std::stoi(dataString);
+			}
+			else {
+				std::cout << "Error when trying to read file" << std::endl;
+				return false;
+			}
+
+			p2 = p2 + 1;
+			p1 = p2;
+
+			checkType = true;
+		}
+	}
+
+	return true;
+}
+
+void DiskHelper::writeJointFrame(std::ostream& file, const JointFrame& jointFrame)
+{
+	file << "Time," << jointFrame.timeStamp << ",";
+	file << "Sensor," << jointFrame.sensorTimestamp << ",";
+	for (int i = 0; i < 25; i++)
+	{
+		file << "Type," << i << ",Confidence," << jointFrame.confidence[i] << ",x," << jointFrame.joints[i].x << ",y," << jointFrame.joints[i].y << ",";
+		file << "rx," << jointFrame.realJoints[i].x << ",ry," << jointFrame.realJoints[i].y << ",rz," << jointFrame.realJoints[i].z << ",";
+	}
+
+	for (int i = 0; i < 19; i++)
+		file << "Angle," << jointFrame.angles[i] << ",";
+
+	for (int i = 0; i < ANATOMICAL_JOINT_COUNT; i++)
+		for (int j = 0; j < ANATOMICAL_AXIS_COUNT; j++)
+			file << "Anatomical," << jointFrame.anatomicalAngles[i][j] << ",";
+}
\ No newline at end of file
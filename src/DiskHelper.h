@@ -9,4 +9,18 @@ public:
 
 	static void readDatafromDisk(const std::string& path, std::vector<JointFrame>& buffer);
 	static void writeDataToDisk(const std::string& path, const std::vector<JointFrame>& buffer);
-};
\ No newline at end of file
+
+	static void readSessionFromDisk(const std::string& path, std::vector<SessionFrame>& buffer);
+	static void writeSessionToDisk(const std::string& path, const std::vector<SessionFrame>& buffer);
+
+	static void readStatisticsFromDisk(const std::string& path, AngleStatistics& statistics);
+	static void writeStatisticsToDisk(const std::string& path, AngleStatistics& statistics);
+
+	static void readKeyframesFromDisk(const std::string& path, std::vector<Keyframe>& keyframes);
+	static void writeKeyframesToDisk(const std::string& path, const std::vector<Keyframe>& keyframes);
+
+private:
+	// Parse a single line of the file. Session fields are only accepted when sessionFrame is set.
+	static bool readJointFrame(const std::string& line, JointFrame& jointFrame, SessionFrame* sessionFrame);
+	static void writeJointFrame(std::ostream& file, const JointFrame& jointFrame);
+};
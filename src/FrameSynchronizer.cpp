@@ -0,0 +1,154 @@
+#include "FrameSynchronizer.h"
+
+#include <algorithm>
+
+template <typename T>
+static uint64_t getDistance(const TimestampRing<T>& ring, int index, uint64_t timestamp)
+{
+	uint64_t other = ring.timestamps[index];
+	return other > timestamp ? other - timestamp : timestamp - other;
+}
+
+FrameSynchronizer::FrameSynchronizer() :
+	tolerance(DEFAULT_SYNC_TOLERANCE)
+{
+}
+
+void FrameSynchronizer::setTolerance(uint64_t microseconds)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	tolerance = microseconds;
+}
+
+uint64_t FrameSynchronizer::getTolerance() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return tolerance;
+}
+
+std::shared_ptr<ColorImage> FrameSynchronizer::acquireColorImage()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Only the pool holds it, so neither the ring nor a bundle refers to it anymore
+	for (const std::shared_ptr<ColorImage>& image : colorImagePool)
+	{
+		if (image.use_count() == 1)
+			return image;
+	}
+
+	colorImagePool.push_back(std::make_shared<ColorImage>());
+	return colorImagePool.back();
+}
+
+void FrameSynchronizer::addColor(const std::shared_ptr<ColorImage>& image)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	colorFrames.push(image, image->frame->getTimestamp());
+}
+
+void FrameSynchronizer::addDepth(const tdv::nuitrack::DepthFrame::Ptr& frame)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	depthFrames.push(frame, frame->getTimestamp());
+}
+
+void FrameSynchronizer::addUser(const tdv::nuitrack::UserFrame::Ptr& frame)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	userFrames.push(frame, frame->getTimestamp());
+}
+
+void FrameSynchronizer::addSkeletons(const tdv::nuitrack::SkeletonData::Ptr& skeletons)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	skeletonFrames.push(skeletons, skeletons->getTimestamp());
+}
+
+tdv::nuitrack::UserFrame::Ptr FrameSynchronizer::getUser(uint64_t timestamp) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (userFrames.count == 0)
+		return tdv::nuitrack::UserFrame::Ptr();
+
+	int index = userFrames.findClosest(timestamp, tolerance);
+	if (index == -1)
+		index = userFrames.newest();
+
+	return userFrames.items[index];
+}
+
+bool FrameSynchronizer::getBundle(FrameBundle& bundle) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Newest skeleton first, the other streams can arrive a little later
+	for (int n = 0; n < skeletonFrames.count; n++)
+	{
+		int skeletonIndex = skeletonFrames.newest(n);
+		uint64_t timestamp = skeletonFrames.timestamps[skeletonIndex];
+
+		int colorIndex = colorFrames.findClosest(timestamp, tolerance);
+		int depthIndex = depthFrames.findClosest(timestamp, tolerance);
+		int userIndex = userFrames.findClosest(timestamp, tolerance);
+
+		// A stream that never delivered anything does not hold the others back
+		if ((colorFrames.count > 0 && colorIndex == -1) ||
+			(depthFrames.count > 0 && depthIndex == -1) ||
+			(userFrames.count > 0 && userIndex == -1))
+			continue;
+
+		bundle.timestamp = timestamp;
+		bundle.skew = 0;
+		bundle.skeletons = skeletonFrames.items[skeletonIndex];
+		bundle.color.reset();
+		bundle.depth.reset();
+		bundle.user.reset();
+
+		if (colorIndex != -1)
+		{
+			bundle.color = colorFrames.items[colorIndex];
+			bundle.skew = (std::max)(bundle.skew, getDistance(colorFrames, colorIndex, timestamp));
+		}
+		if (depthIndex != -1)
+		{
+			bundle.depth = depthFrames.items[depthIndex];
+			bundle.skew = (std::max)(bundle.skew, getDistance(depthFrames, depthIndex, timestamp));
+		}
+		if (userIndex != -1)
+		{
+			bundle.user = userFrames.items[userIndex];
+			bundle.skew = (std::max)(bundle.skew, getDistance(userFrames, userIndex, timestamp));
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+void FrameSynchronizer::getLatest(FrameBundle& bundle) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	bundle.timestamp = 0;
+	bundle.skew = 0;
+	bundle.color = colorFrames.count > 0 ? colorFrames.items[colorFrames.newest()] : std::shared_ptr<const ColorImage>();
+	bundle.depth = depthFrames.count > 0 ? depthFrames.items[depthFrames.newest()] : tdv::nuitrack::DepthFrame::Ptr();
+	bundle.user = userFrames.count > 0 ? userFrames.items[userFrames.newest()] : tdv::nuitrack::UserFrame::Ptr();
+	bundle.skeletons = skeletonFrames.count > 0 ? skeletonFrames.items[skeletonFrames.newest()] : tdv::nuitrack::SkeletonData::Ptr();
+
+	if (bundle.skeletons)
+		bundle.timestamp = skeletonFrames.timestamps[skeletonFrames.newest()];
+}
+
+void FrameSynchronizer::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	colorFrames.clear();
+	depthFrames.clear();
+	userFrames.clear();
+	skeletonFrames.clear();
+	colorImagePool.clear();
+}
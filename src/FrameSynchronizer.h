@@ -0,0 +1,129 @@
+#pragma once
+
+#include <nuitrack/Nuitrack.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#define SYNC_RING_SIZE 8
+#define DEFAULT_SYNC_TOLERANCE 20000 // Microseconds, a bit more than half a frame at 30 fps
+
+// A color frame on its way to the renderer. With privacy masking on the
+// masked copy is shown instead of the sensor data, its storage is reused.
+struct ColorImage
+{
+	tdv::nuitrack::RGBFrame::Ptr frame;
+	std::vector<uint8_t> masked;
+	bool isMasked = false;
+
+	const void* getData() const { return isMasked ? (const void*)masked.data() : (const void*)frame->getData(); }
+};
+
+// Frames of the different modules that were captured at the same time.
+// Only references are held, none of the frame data is copied.
+struct FrameBundle
+{
+	uint64_t timestamp = 0; // Of the skeleton frame, in microseconds
+	uint64_t skew = 0; // Largest timestamp difference between the skeleton and another frame
+	std::shared_ptr<const ColorImage> color;
+	tdv::nuitrack::DepthFrame::Ptr depth;
+	tdv::nuitrack::UserFrame::Ptr user;
+	tdv::nuitrack::SkeletonData::Ptr skeletons;
+};
+
+// The last few frames of a stream with their timestamps, the oldest is overwritten
+template <typename T>
+struct TimestampRing
+{
+	T items[SYNC_RING_SIZE];
+	uint64_t timestamps[SYNC_RING_SIZE];
+	int next = 0;
+	int count = 0;
+
+	void push(const T& item, uint64_t timestamp)
+	{
+		items[next] = item;
+		timestamps[next] = timestamp;
+		next = (next + 1) % SYNC_RING_SIZE;
+		if (count < SYNC_RING_SIZE)
+			count++;
+	}
+
+	// Index of the n-th newest item
+	int newest(int n = 0) const { return (next - 1 - n + 2 * SYNC_RING_SIZE) % SYNC_RING_SIZE; }
+
+	// Index of the item closest in time, -1 if none is within the tolerance
+	int findClosest(uint64_t timestamp, uint64_t tolerance) const
+	{
+		int best = -1;
+		uint64_t bestDistance = tolerance;
+		for (int n = 0; n < count; n++)
+		{
+			int index = newest(n);
+			uint64_t distance = timestamps[index] > timestamp ? timestamps[index] - timestamp : timestamp - timestamps[index];
+			if (distance <= bestDistance)
+			{
+				best = index;
+				bestDistance = distance;
+			}
+		}
+		return best;
+	}
+
+	void clear()
+	{
+		for (int i = 0; i < SYNC_RING_SIZE; i++)
+			items[i] = T();
+		next = 0;
+		count = 0;
+	}
+};
+
+// Groups the color, depth, user and skeleton frames Nuitrack delivers through separate callbacks
+// into bundles by their timestamps, so the skeleton is drawn over the image it was tracked on.
+// Every stream keeps its last SYNC_RING_SIZE frames. A bundle is built around a skeleton frame
+// from the frames of the other streams closest in time, if they are within the tolerance.
+// The producer side runs in the Nuitrack callbacks, the consumer side in the render loop. Nuitrack
+// calls the callbacks from inside Nuitrack::update, which the render loop calls, so both sides are on
+// the render thread and take turns. The single mutex is never contended and scanning the few pooled
+// color images under it is cheap, a lock-free handover would not gain anything here. The lock
+// is what keeps it correct if the callbacks are ever moved to a thread of their own.
+class FrameSynchronizer
+{
+public:
+	FrameSynchronizer();
+
+	void setTolerance(uint64_t microseconds);
+	uint64_t getTolerance() const;
+
+	// Color image to fill in the callback. Images no bundle refers to anymore are reused,
+	// so the masked pixels are not reallocated every frame.
+	std::shared_ptr<ColorImage> acquireColorImage();
+	void addColor(const std::shared_ptr<ColorImage>& image);
+	void addDepth(const tdv::nuitrack::DepthFrame::Ptr& frame);
+	void addUser(const tdv::nuitrack::UserFrame::Ptr& frame);
+	void addSkeletons(const tdv::nuitrack::SkeletonData::Ptr& skeletons);
+
+	// Label map closest in time, the newest one if none is within the tolerance
+	tdv::nuitrack::UserFrame::Ptr getUser(uint64_t timestamp) const;
+
+	// Bundle of the newest skeleton frame that has a match in every stream that delivered frames.
+	// Returns false if none of the buffered skeleton frames could be matched.
+	bool getBundle(FrameBundle& bundle) const;
+	// Newest frame of every stream, regardless of their timestamps
+	void getLatest(FrameBundle& bundle) const;
+
+	void clear();
+
+private:
+	mutable std::mutex mutex;
+	uint64_t tolerance;
+
+	TimestampRing<std::shared_ptr<const ColorImage>> colorFrames;
+	TimestampRing<tdv::nuitrack::DepthFrame::Ptr> depthFrames;
+	TimestampRing<tdv::nuitrack::UserFrame::Ptr> userFrames;
+	TimestampRing<tdv::nuitrack::SkeletonData::Ptr> skeletonFrames;
+
+	std::vector<std::shared_ptr<ColorImage>> colorImagePool;
+};
@@ -0,0 +1,359 @@
+#include "JpegEncoder.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// Natural index of every coefficient in zigzag order
+static const uint8_t zigzag[64] =
+{
+	0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Tables from Annex K of the JPEG standard, natural order
+static const uint8_t baseLuminanceTable[64] =
+{
+	16, 11, 10, 16, 24, 40, 51, 61,
+	12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56,
+	14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77,
+	24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103, 99
+};
+
+static const uint8_t baseChrominanceTable[64] =
+{
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// Number of codes of every length 1-16, then the symbols in code order
+static const uint8_t luminanceDCBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t luminanceDCValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const uint8_t chrominanceDCBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t chrominanceDCValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t luminanceACBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t luminanceACValues[162] =
+{
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+static const uint8_t chrominanceACBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t chrominanceACValues[162] =
+{
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+	0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+	0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+// Scale of every row and column of the AAN DCT output
+static const float dctScale[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+static void buildHuffmanCodes(const uint8_t* bits, const uint8_t* values, HuffmanCode* codes)
+{
+	memset(codes, 0, 256 * sizeof(HuffmanCode));
+
+	uint16_t code = 0;
+	int k = 0;
+	for (int length = 1; length <= 16; length++)
+	{
+		for (int i = 0; i < bits[length - 1]; i++)
+		{
+			codes[values[k]].code = code;
+			codes[values[k]].length = (uint8_t)length;
+			code++;
+			k++;
+		}
+		code <<= 1;
+	}
+}
+
+// Arai, Agui and Nakajima, scaled by dctScale and 8 which the divisors take out again
+static void forwardDCT(float* d0, float* d1, float* d2, float* d3, float* d4, float* d5, float* d6, float* d7)
+{
+	float tmp0 = *d0 + *d7;
+	float tmp7 = *d0 - *d7;
+	float tmp1 = *d1 + *d6;
+	float tmp6 = *d1 - *d6;
+	float tmp2 = *d2 + *d5;
+	float tmp5 = *d2 - *d5;
+	float tmp3 = *d3 + *d4;
+	float tmp4 = *d3 - *d4;
+
+	// Even part
+	float tmp10 = tmp0 + tmp3;
+	float tmp13 = tmp0 - tmp3;
+	float tmp11 = tmp1 + tmp2;
+	float tmp12 = tmp1 - tmp2;
+
+	*d0 = tmp10 + tmp11;
+	*d4 = tmp10 - tmp11;
+
+	float z1 = (tmp12 + tmp13) * 0.707106781f;
+	*d2 = tmp13 + z1;
+	*d6 = tmp13 - z1;
+
+	// Odd part
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+
+	float z5 = (tmp10 - tmp12) * 0.382683433f;
+	float z2 = tmp10 * 0.541196100f + z5;
+	float z4 = tmp12 * 1.306562965f + z5;
+	float z3 = tmp11 * 0.707106781f;
+
+	float z11 = tmp7 + z3;
+	float z13 = tmp7 - z3;
+
+	*d5 = z13 + z2;
+	*d3 = z13 - z2;
+	*d1 = z11 + z4;
+	*d7 = z11 - z4;
+}
+
+// Collects codes and writes them out a byte at a time, a 0xFF byte is followed by 0x00
+struct BitWriter
+{
+	std::vector<uint8_t>& output;
+	uint32_t buffer;
+	int count;
+
+	BitWriter(std::vector<uint8_t>& output) : output(output), buffer(0), count(0) {}
+
+	void write(uint16_t bits, int length)
+	{
+		buffer = (buffer << length) | (bits & ((1u << length) - 1));
+		count += length;
+		while (count >= 8)
+		{
+			uint8_t byte = (uint8_t)(buffer >> (count - 8));
+			output.push_back(byte);
+			if (byte == 0xFF)
+				output.push_back(0);
+			count -= 8;
+		}
+	}
+
+	// Pads the last byte with ones
+	void flush()
+	{
+		if (count > 0)
+			write(0x7F, 8 - count);
+	}
+};
+
+static void writeMarker(std::vector<uint8_t>& output, uint8_t marker, int length)
+{
+	output.push_back(0xFF);
+	output.push_back(marker);
+	output.push_back((uint8_t)(length >> 8));
+	output.push_back((uint8_t)(length & 0xFF));
+}
+
+static void writeHuffmanTable(std::vector<uint8_t>& output, uint8_t tableClass, const uint8_t* bits, const uint8_t* values, int valueCount)
+{
+	output.push_back(tableClass);
+	output.insert(output.end(), bits, bits + 16);
+	output.insert(output.end(), values, values + valueCount);
+}
+
+// Number of bits the magnitude of value needs and its bits, negative values are stored one less
+static void getCategory(int value, int& category, uint16_t& bits)
+{
+	int magnitude = value < 0 ? -value : value;
+	category = 0;
+	while (magnitude)
+	{
+		category++;
+		magnitude >>= 1;
+	}
+	bits = (uint16_t)(value < 0 ? value - 1 : value);
+}
+
+static int encodeBlock(BitWriter& writer, float* block, const float* divisors, int previousDC, const HuffmanCode* dc, const HuffmanCode* ac)
+{
+	// Rows, then columns
+	for (int i = 0; i < 64; i += 8)
+		forwardDCT(&block[i], &block[i + 1], &block[i + 2], &block[i + 3], &block[i + 4], &block[i + 5], &block[i + 6], &block[i + 7]);
+	for (int i = 0; i < 8; i++)
+		forwardDCT(&block[i], &block[i + 8], &block[i + 16], &block[i + 24], &block[i + 32], &block[i + 40], &block[i + 48], &block[i + 56]);
+
+	int quantized[64];
+	for (int k = 0; k < 64; k++)
+	{
+		float value = block[zigzag[k]] * divisors[zigzag[k]];
+		quantized[k] = (int)(value < 0.0f ? value - 0.5f : value + 0.5f);
+	}
+
+	int category;
+	uint16_t bits;
+
+	getCategory(quantized[0] - previousDC, category, bits);
+	writer.write(dc[category].code, dc[category].length);
+	if (category)
+		writer.write(bits, category);
+
+	int last = 63;
+	while (last > 0 && quantized[last] == 0)
+		last--;
+
+	int run = 0;
+	for (int k = 1; k <= last; k++)
+	{
+		if (quantized[k] == 0)
+		{
+			run++;
+			continue;
+		}
+
+		// 16 zeros at a time
+		while (run >= 16)
+		{
+			writer.write(ac[0xF0].code, ac[0xF0].length);
+			run -= 16;
+		}
+
+		getCategory(quantized[k], category, bits);
+		int symbol = (run << 4) | category;
+		writer.write(ac[symbol].code, ac[symbol].length);
+		writer.write(bits, category);
+		run = 0;
+	}
+
+	// End of block, unless the last coefficient is not zero
+	if (last != 63)
+		writer.write(ac[0x00].code, ac[0x00].length);
+
+	return quantized[0];
+}
+
+JpegEncoder::JpegEncoder(int quality)
+{
+	quality = (std::max)(1, (std::min)(quality, 100));
+	int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+	for (int k = 0; k < 64; k++)
+	{
+		int natural = zigzag[k];
+		luminanceTable[k] = (uint8_t)(std::max)(1, (std::min)((baseLuminanceTable[natural] * scale + 50) / 100, 255));
+		chrominanceTable[k] = (uint8_t)(std::max)(1, (std::min)((baseChrominanceTable[natural] * scale + 50) / 100, 255));
+	}
+
+	for (int k = 0; k < 64; k++)
+	{
+		int natural = zigzag[k];
+		float scaleFactor = dctScale[natural / 8] * dctScale[natural % 8] * 8.0f;
+		luminanceDivisors[natural] = 1.0f / (luminanceTable[k] * scaleFactor);
+		chrominanceDivisors[natural] = 1.0f / (chrominanceTable[k] * scaleFactor);
+	}
+
+	buildHuffmanCodes(luminanceDCBits, luminanceDCValues, luminanceDC);
+	buildHuffmanCodes(luminanceACBits, luminanceACValues, luminanceAC);
+	buildHuffmanCodes(chrominanceDCBits, chrominanceDCValues, chrominanceDC);
+	buildHuffmanCodes(chrominanceACBits, chrominanceACValues, chrominanceAC);
+}
+
+void JpegEncoder::encode(const uint8_t* rgba, int width, int height, std::vector<uint8_t>& output) const
+{
+	output.clear();
+
+	// Start of image and a JFIF header with square pixels
+	static const uint8_t header[] = { 0xFF, 0xD8, 0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	output.insert(output.end(), header, header + sizeof(header));
+
+	writeMarker(output, 0xDB, 2 + 2 * 65);
+	output.push_back(0);
+	output.insert(output.end(), luminanceTable, luminanceTable + 64);
+	output.push_back(1);
+	output.insert(output.end(), chrominanceTable, chrominanceTable + 64);
+
+	// Three components at full resolution, Y with table 0 and the chroma with table 1
+	writeMarker(output, 0xC0, 17);
+	output.push_back(8);
+	output.push_back((uint8_t)(height >> 8));
+	output.push_back((uint8_t)(height & 0xFF));
+	output.push_back((uint8_t)(width >> 8));
+	output.push_back((uint8_t)(width & 0xFF));
+	output.push_back(3);
+	static const uint8_t components[] = { 1, 0x11, 0, 2, 0x11, 1, 3, 0x11, 1 };
+	output.insert(output.end(), components, components + sizeof(components));
+
+	writeMarker(output, 0xC4, 2 + 4 * 17 + 12 + 12 + 162 + 162);
+	writeHuffmanTable(output, 0x00, luminanceDCBits, luminanceDCValues, 12);
+	writeHuffmanTable(output, 0x10, luminanceACBits, luminanceACValues, 162);
+	writeHuffmanTable(output, 0x01, chrominanceDCBits, chrominanceDCValues, 12);
+	writeHuffmanTable(output, 0x11, chrominanceACBits, chrominanceACValues, 162);
+
+	writeMarker(output, 0xDA, 12);
+	static const uint8_t scan[] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+	output.insert(output.end(), scan, scan + sizeof(scan));
+
+	BitWriter writer(output);
+	int previousY = 0;
+	int previousCb = 0;
+	int previousCr = 0;
+	float y[64];
+	float cb[64];
+	float cr[64];
+
+	for (int blockY = 0; blockY < height; blockY += 8)
+	{
+		for (int blockX = 0; blockX < width; blockX += 8)
+		{
+			for (int i = 0; i < 64; i++)
+			{
+				// Edge blocks repeat the last row and column, the top row is the last one read back
+				int x = (std::min)(blockX + (i & 7), width - 1);
+				int row = height - 1 - (std::min)(blockY + (i >> 3), height - 1);
+				const uint8_t* pixel = rgba + ((size_t)row * width + x) * 4;
+
+				float r = pixel[0];
+				float g = pixel[1];
+				float b = pixel[2];
+				y[i] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+				cb[i] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+				cr[i] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+			}
+
+			previousY = encodeBlock(writer, y, luminanceDivisors, previousY, luminanceDC, luminanceAC);
+			previousCb = encodeBlock(writer, cb, chrominanceDivisors, previousCb, chrominanceDC, chrominanceAC);
+			previousCr = encodeBlock(writer, cr, chrominanceDivisors, previousCr, chrominanceDC, chrominanceAC);
+		}
+	}
+
+	writer.flush();
+
+	output.push_back(0xFF);
+	output.push_back(0xD9);
+}
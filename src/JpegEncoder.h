@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Huffman code of a symbol, the bits are in the low length bits of code
+struct HuffmanCode
+{
+	uint16_t code;
+	uint8_t length;
+};
+
+// Baseline JPEG with the standard Huffman tables and no chroma subsampling, enough for
+// video frames of skeleton overlays. The tables are built once, encode() only reads them
+// so one encoder can be shared by several threads.
+class JpegEncoder final
+{
+public:
+	// Quality 1-100 like libjpeg
+	explicit JpegEncoder(int quality = 85);
+
+	// Pixels are RGBA rows from the bottom up, as glReadPixels returns them
+	void encode(const uint8_t* rgba, int width, int height, std::vector<uint8_t>& output) const;
+
+private:
+	uint8_t luminanceTable[64]; // Quantization tables in zigzag order, as they are written
+	uint8_t chrominanceTable[64];
+	float luminanceDivisors[64]; // Reciprocal of the quantizer and the DCT scale, natural order
+	float chrominanceDivisors[64];
+	HuffmanCode luminanceDC[256];
+	HuffmanCode luminanceAC[256];
+	HuffmanCode chrominanceDC[256];
+	HuffmanCode chrominanceAC[256];
+};
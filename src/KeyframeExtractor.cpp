@@ -0,0 +1,237 @@
+#include "KeyframeExtractor.h"
+#include "NuitrackGL.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <cfloat>
+#include <random>
+#include <functional>
+#include <algorithm>
+
+#define ANGLE_COUNT 19
+#define FEATURE_SIZE (2 * ANGLE_COUNT)
+#define MAX_ITERATIONS 50
+
+static const float DEGREES_TO_RADIANS = 3.14159265358979323846f / 180.0f;
+
+static void getFeatures(const int* angles, float* features)
+{
+	for (int i = 0; i < ANGLE_COUNT; i++)
+	{
+		features[2 * i] = cos(angles[i] * DEGREES_TO_RADIANS);
+		features[2 * i + 1] = sin(angles[i] * DEGREES_TO_RADIANS);
+	}
+}
+
+static float getDistance(const float* a, const float* b)
+{
+	float distance = 0.0f;
+	for (int i = 0; i < FEATURE_SIZE; i++)
+	{
+		float d = a[i] - b[i];
+		distance += d * d;
+	}
+	return distance;
+}
+
+// Runs work(begin, end, chunk) over [0, count) split evenly between the threads of the pool
+static void parallelFor(WorkerPool& workers, int count, const std::function<void(int, int, int)>& work)
+{
+	int threadCount = workers.getThreadCount();
+	int chunk = (count + threadCount - 1) / threadCount;
+
+	for (int t = 0; t < threadCount; t++)
+	{
+		int begin = t * chunk;
+		int end = (std::min)(count, begin + chunk);
+		if (begin >= end)
+			break;
+		workers.submit([&work, begin, end, t] { work(begin, end, t); });
+	}
+
+	workers.wait();
+}
+
+void KeyframeExtractor::extract(const std::vector<JointFrame>& frames, int count, std::vector<Keyframe>& keyframes)
+{
+	keyframes.clear();
+
+	int frameCount = (int)frames.size();
+	count = (std::min)(count, frameCount);
+	if (count <= 0)
+		return;
+
+	// Started once, every step below is split between the same threads
+	WorkerPool workers((std::max)(1, (int)std::thread::hardware_concurrency()));
+	int threadCount = workers.getThreadCount();
+
+	std::vector<float> features(frameCount * FEATURE_SIZE);
+	parallelFor(workers, frameCount, [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++)
+			getFeatures(frames[i].angles, &features[i * FEATURE_SIZE]);
+	});
+
+	// k-means++ seeding, fixed seed so the same recording always gives the same keyframes
+	std::mt19937 random(1234);
+	std::vector<float> centroids(count * FEATURE_SIZE);
+	std::vector<float> nearest(frameCount, FLT_MAX);
+
+	int first = std::uniform_int_distribution<int>(0, frameCount - 1)(random);
+	std::copy(&features[first * FEATURE_SIZE], &features[first * FEATURE_SIZE] + FEATURE_SIZE, &centroids[0]);
+
+	for (int c = 1; c < count; c++)
+	{
+		const float* previous = &centroids[(c - 1) * FEATURE_SIZE];
+		parallelFor(workers, frameCount, [&](int begin, int end, int) {
+			for (int i = begin; i < end; i++)
+				nearest[i] = (std::min)(nearest[i], getDistance(&features[i * FEATURE_SIZE], previous));
+		});
+
+		// Every frame is already a centroid, e.g. a recording of someone standing still
+		int chosen = first;
+		if (*std::max_element(nearest.begin(), nearest.end()) > 0.0f)
+		{
+			std::discrete_distribution<int> pick(nearest.begin(), nearest.end());
+			chosen = pick(random);
+		}
+		std::copy(&features[chosen * FEATURE_SIZE], &features[chosen * FEATURE_SIZE] + FEATURE_SIZE, &centroids[c * FEATURE_SIZE]);
+	}
+
+	// Lloyd iterations. Every chunk keeps its own sums so no locking is needed.
+	std::vector<int> assignments(frameCount, -1);
+	std::vector<float> sums(threadCount * count * FEATURE_SIZE);
+	std::vector<int> sizes(threadCount * count);
+	std::vector<int> changes(threadCount);
+
+	for (int iteration = 0; iteration < MAX_ITERATIONS; iteration++)
+	{
+		std::fill(sums.begin(), sums.end(), 0.0f);
+		std::fill(sizes.begin(), sizes.end(), 0);
+		std::fill(changes.begin(), changes.end(), 0);
+
+		parallelFor(workers, frameCount, [&](int begin, int end, int thread) {
+			float* threadSums = &sums[thread * count * FEATURE_SIZE];
+			int* threadSizes = &sizes[thread * count];
+
+			for (int i = begin; i < end; i++)
+			{
+				const float* feature = &features[i * FEATURE_SIZE];
+
+				int best = 0;
+				float bestDistance = FLT_MAX;
+				for (int c = 0; c < count; c++)
+				{
+					float distance = getDistance(feature, &centroids[c * FEATURE_SIZE]);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = c;
+					}
+				}
+
+				if (assignments[i] != best)
+				{
+					assignments[i] = best;
+					changes[thread]++;
+				}
+
+				threadSizes[best]++;
+				for (int f = 0; f < FEATURE_SIZE; f++)
+					threadSums[best * FEATURE_SIZE + f] += feature[f];
+			}
+		});
+
+		int changed = 0;
+		for (int t = 0; t < threadCount; t++)
+			changed += changes[t];
+
+		if (changed == 0)
+			break;
+
+		for (int c = 0; c < count; c++)
+		{
+			int size = 0;
+			for (int t = 0; t < threadCount; t++)
+				size += sizes[t * count + c];
+
+			// Leave empty clusters where they are
+			if (size == 0)
+				continue;
+
+			for (int f = 0; f < FEATURE_SIZE; f++)
+			{
+				float sum = 0.0f;
+				for (int t = 0; t < threadCount; t++)
+					sum += sums[(t * count + c) * FEATURE_SIZE + f];
+				centroids[c * FEATURE_SIZE + f] = sum / size;
+			}
+		}
+	}
+
+	// Medoids: the closest real frame to each centroid, found per chunk then reduced
+	std::vector<int> medoids(threadCount * count, -1);
+	std::vector<float> medoidDistances(threadCount * count, FLT_MAX);
+	std::fill(sizes.begin(), sizes.end(), 0);
+
+	parallelFor(workers, frameCount, [&](int begin, int end, int thread) {
+		for (int i = begin; i < end; i++)
+		{
+			int c = assignments[i];
+			int slot = thread * count + c;
+			float distance = getDistance(&features[i * FEATURE_SIZE], &centroids[c * FEATURE_SIZE]);
+
+			sizes[slot]++;
+			if (distance < medoidDistances[slot])
+			{
+				medoidDistances[slot] = distance;
+				medoids[slot] = i;
+			}
+		}
+	});
+
+	for (int c = 0; c < count; c++)
+	{
+		Keyframe keyframe = { -1, 0 };
+		float bestDistance = FLT_MAX;
+
+		for (int t = 0; t < threadCount; t++)
+		{
+			int slot = t * count + c;
+			keyframe.clusterSize += sizes[slot];
+			if (medoids[slot] >= 0 && medoidDistances[slot] < bestDistance)
+			{
+				bestDistance = medoidDistances[slot];
+				keyframe.frame = medoids[slot];
+			}
+		}
+
+		if (keyframe.frame >= 0)
+			keyframes.push_back(keyframe);
+	}
+
+	std::sort(keyframes.begin(), keyframes.end(), [](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+}
+
+int KeyframeExtractor::findClosest(const std::vector<JointFrame>& frames, const std::vector<Keyframe>& keyframes, const int* angles)
+{
+	float pose[FEATURE_SIZE];
+	float keyPose[FEATURE_SIZE];
+	getFeatures(angles, pose);
+
+	int best = -1;
+	float bestDistance = FLT_MAX;
+
+	for (int i = 0; i < (int)keyframes.size(); i++)
+	{
+		getFeatures(frames[keyframes[i].frame].angles, keyPose);
+
+		float distance = getDistance(pose, keyPose);
+		if (distance < bestDistance)
+		{
+			bestDistance = distance;
+			best = i;
+		}
+	}
+
+	return best;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+struct JointFrame;
+
+struct Keyframe
+{
+	int frame; // Index of the representative frame in the recording
+	int clusterSize; // Number of frames the key pose stands for
+};
+
+// Picks representative key poses from a recording by clustering every frame with k-means.
+// Each angle is mapped onto the unit circle so 359 and 1 degrees are close together.
+// Assignment and update steps are split across all hardware threads, and every cluster is
+// represented by its medoid (the real frame closest to the centroid) so keyframes can be replayed.
+class KeyframeExtractor final
+{
+public:
+	// Keyframes are returned in the order they appear in the recording
+	static void extract(const std::vector<JointFrame>& frames, int count, std::vector<Keyframe>& keyframes);
+
+	// Coarse matching of a pose against the keyframes, returns an index into keyframes or -1
+	static int findClosest(const std::vector<JointFrame>& frames, const std::vector<Keyframe>& keyframes, const int* angles);
+};
@@ -0,0 +1,400 @@
+#include "MotionTrails.h"
+#include "ShaderManager.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+// Joints that leave a trail, the ends of the limbs move the most
+static const int trailJoints[TRAIL_JOINT_COUNT] =
+{
+	tdv::nuitrack::JOINT_LEFT_HAND,
+	tdv::nuitrack::JOINT_RIGHT_HAND,
+	tdv::nuitrack::JOINT_LEFT_KNEE,
+	tdv::nuitrack::JOINT_RIGHT_KNEE,
+	tdv::nuitrack::JOINT_LEFT_ANKLE,
+	tdv::nuitrack::JOINT_RIGHT_ANKLE
+};
+
+// Finds the texel of a joint in a pose that is age poses older than the newest of its slot
+#define RING_LOOKUP \
+"uniform samplerBuffer poses;\n" \
+"uniform int poseCount;\n" \
+"uniform ivec2 rings[8];\n" /* TRAIL_SLOT_COUNT, head and count */ \
+"uniform vec4 colors[8];\n" \
+"uniform vec2 viewportSize;\n" \
+"uniform float halfWidth;\n" \
+"vec4 fetchJoint(int slot, int age, int joint)\n" \
+"{\n" \
+"   int pose = (rings[slot].x - age + poseCount) % poseCount;\n" \
+"   return texelFetch(poses, (slot * poseCount + pose) * 25 + joint);\n" /* SKELETON_JOINT_COUNT */ \
+"}\n"
+
+// Every instance is one segment of a trail between two consecutive poses of a joint.
+// Older segments get thinner and fade out.
+static const char* trailVertexShaderSource =
+"#version 330 core\n"
+RING_LOOKUP
+"uniform int trailJoints[6];\n" // TRAIL_JOINT_COUNT
+"flat out vec4 color;\n"
+"flat out float segmentHalfWidth;\n"
+"out float across;\n" // Distance from the centre line in pixels
+"void main()\n"
+"{\n"
+"   int segments = poseCount - 1;\n"
+"   int slot = gl_InstanceID / (6 * segments);\n"
+"   int rest = gl_InstanceID - slot * 6 * segments;\n"
+"   int joint = trailJoints[rest / segments];\n"
+"   int age = rest - (rest / segments) * segments;\n"
+"   color = vec4(0.0);\n"
+"   segmentHalfWidth = 0.0;\n"
+"   across = 0.0;\n"
+"   if (age + 1 >= rings[slot].y)\n"
+"   {\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   vec4 a = fetchJoint(slot, age, joint);\n"
+"   vec4 b = fetchJoint(slot, age + 1, joint);\n"
+"   if (a.z <= 0.15 || b.z <= 0.15)\n"
+"   {\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   float fade = 1.0 - (float(age) + 0.5) / float(poseCount);\n"
+"   color = vec4(colors[slot].rgb, colors[slot].a * fade);\n"
+"   segmentHalfWidth = halfWidth * (0.4 + 0.6 * fade);\n"
+"   vec2 start = (1.0 - a.xy) * viewportSize;\n"
+"   vec2 axis = (1.0 - b.xy) * viewportSize - start;\n"
+"   float segmentLength = length(axis);\n"
+"   vec2 direction = segmentLength > 0.0 ? axis / segmentLength : vec2(1.0, 0.0);\n"
+"   vec2 normal = vec2(-direction.y, direction.x);\n"
+"   // No caps, the segments of a trail meet end to end without blending twice\n"
+"   vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+"   across = mix(-segmentHalfWidth - 1.0, segmentHalfWidth + 1.0, corner.y);\n"
+"   vec2 position = start + axis * corner.x + normal * across;\n"
+"   gl_Position = vec4(position / viewportSize * 2.0 - 1.0, 0.0, 1.0);\n"
+"}\n";
+
+static const char* trailFragmentShaderSource =
+"#version 330 core\n"
+"flat in vec4 color;\n"
+"flat in float segmentHalfWidth;\n"
+"in float across;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   float coverage = clamp(segmentHalfWidth + 0.5 - abs(across), 0.0, 1.0);\n"
+"   if (coverage == 0.0)\n"
+"       discard;\n"
+"   FragColor = vec4(color.rgb, color.a * coverage);\n"
+"}\n";
+
+// Every instance is one bone of one ghost, the ghosts are the poses evenly spread over the history
+static const char* ghostVertexShaderSource =
+"#version 330 core\n"
+RING_LOOKUP
+"uniform isamplerBuffer bones;\n"
+"uniform int ghostCount;\n"
+"uniform int boneCount;\n"
+"flat out vec4 color;\n"
+"flat out float boneLength;\n"
+"out vec2 local;\n"
+"void main()\n"
+"{\n"
+"   int slot = gl_InstanceID / (ghostCount * boneCount);\n"
+"   int rest = gl_InstanceID - slot * ghostCount * boneCount;\n"
+"   int ghost = rest / boneCount + 1;\n"
+"   ivec2 bone = texelFetch(bones, rest - (ghost - 1) * boneCount).xy;\n"
+"   int age = ghost * (poseCount - 1) / ghostCount;\n"
+"   color = vec4(0.0);\n"
+"   boneLength = 0.0;\n"
+"   local = vec2(0.0);\n"
+"   if (age >= rings[slot].y)\n"
+"   {\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   vec4 a = fetchJoint(slot, age, bone.x);\n"
+"   vec4 b = fetchJoint(slot, age, bone.y);\n"
+"   if (a.z <= 0.15 || b.z <= 0.15)\n"
+"   {\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   color = vec4(colors[slot].rgb, colors[slot].a * 0.5 * (1.0 - float(age) / float(poseCount)));\n"
+"   vec2 start = (1.0 - a.xy) * viewportSize;\n"
+"   vec2 axis = (1.0 - b.xy) * viewportSize - start;\n"
+"   boneLength = length(axis);\n"
+"   vec2 direction = boneLength > 0.0 ? axis / boneLength : vec2(1.0, 0.0);\n"
+"   vec2 normal = vec2(-direction.y, direction.x);\n"
+"   float extent = halfWidth + 1.0;\n"
+"   vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+"   local = vec2(mix(-extent, boneLength + extent, corner.x), mix(-extent, extent, corner.y));\n"
+"   vec2 position = start + direction * local.x + normal * local.y;\n"
+"   gl_Position = vec4(position / viewportSize * 2.0 - 1.0, 0.0, 1.0);\n"
+"}\n";
+
+// Capsules like the skeleton overlay
+static const char* ghostFragmentShaderSource =
+"#version 330 core\n"
+"uniform float halfWidth;\n"
+"flat in vec4 color;\n"
+"flat in float boneLength;\n"
+"in vec2 local;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   float distance = length(vec2(local.x - clamp(local.x, 0.0, boneLength), local.y));\n"
+"   float coverage = clamp(halfWidth + 0.5 - distance, 0.0, 1.0);\n"
+"   if (coverage == 0.0)\n"
+"       discard;\n"
+"   FragColor = vec4(color.rgb, color.a * coverage);\n"
+"}\n";
+
+static const ShaderProgramSource trailProgramSource = { "trail", &trailVertexShaderSource, 1, &trailFragmentShaderSource, 1 };
+static const ShaderProgramSource ghostProgramSource = { "trail_ghost", &ghostVertexShaderSource, 1, &ghostFragmentShaderSource, 1 };
+static ShaderRegistration trailRegistration(trailProgramSource);
+static ShaderRegistration ghostRegistration(ghostProgramSource);
+
+MotionTrails::MotionTrails() :
+	trailProgram(0),
+	ghostProgram(0),
+	VAO(0),
+	boneBuffer(0),
+	boneTexture(0),
+	poseBuffer(0),
+	poseTexture(0),
+	boneCount(0),
+	poseCount(30),
+	trailPoseCountUniformLocation(-1),
+	trailRingsUniformLocation(-1),
+	trailColorsUniformLocation(-1),
+	trailViewportSizeUniformLocation(-1),
+	trailHalfWidthUniformLocation(-1),
+	ghostPoseCountUniformLocation(-1),
+	ghostRingsUniformLocation(-1),
+	ghostColorsUniformLocation(-1),
+	ghostViewportSizeUniformLocation(-1),
+	ghostHalfWidthUniformLocation(-1),
+	ghostCountUniformLocation(-1),
+	ghostBoneCountUniformLocation(-1)
+{
+	memset(slots, 0, sizeof(slots));
+}
+
+void MotionTrails::init(const int (*bones)[2], int boneCount)
+{
+	this->boneCount = boneCount;
+
+	trailProgram = ShaderManager::getProgram(trailProgramSource);
+	ghostProgram = ShaderManager::getProgram(ghostProgramSource);
+
+	GLCall(trailPoseCountUniformLocation = glGetUniformLocation(trailProgram, "poseCount"));
+	GLCall(trailRingsUniformLocation = glGetUniformLocation(trailProgram, "rings"));
+	GLCall(trailColorsUniformLocation = glGetUniformLocation(trailProgram, "colors"));
+	GLCall(trailViewportSizeUniformLocation = glGetUniformLocation(trailProgram, "viewportSize"));
+	GLCall(trailHalfWidthUniformLocation = glGetUniformLocation(trailProgram, "halfWidth"));
+	GLCall(ghostPoseCountUniformLocation = glGetUniformLocation(ghostProgram, "poseCount"));
+	GLCall(ghostRingsUniformLocation = glGetUniformLocation(ghostProgram, "rings"));
+	GLCall(ghostColorsUniformLocation = glGetUniformLocation(ghostProgram, "colors"));
+	GLCall(ghostViewportSizeUniformLocation = glGetUniformLocation(ghostProgram, "viewportSize"));
+	GLCall(ghostHalfWidthUniformLocation = glGetUniformLocation(ghostProgram, "halfWidth"));
+	GLCall(ghostCountUniformLocation = glGetUniformLocation(ghostProgram, "ghostCount"));
+	GLCall(ghostBoneCountUniformLocation = glGetUniformLocation(ghostProgram, "boneCount"));
+
+	// Same units as the skeleton overlay, which binds its own buffers before drawing
+	GLCall(glUseProgram(trailProgram));
+	GLCall(glUniform1i(glGetUniformLocation(trailProgram, "poses"), 2));
+	GLCall(glUniform1iv(glGetUniformLocation(trailProgram, "trailJoints"), TRAIL_JOINT_COUNT, trailJoints));
+	GLCall(glUseProgram(ghostProgram));
+	GLCall(glUniform1i(glGetUniformLocation(ghostProgram, "poses"), 2));
+	GLCall(glUniform1i(glGetUniformLocation(ghostProgram, "bones"), 3));
+	GLCall(glUseProgram(0));
+
+	std::vector<GLint> boneJoints;
+	for (int i = 0; i < boneCount; i++)
+	{
+		boneJoints.push_back(bones[i][0]);
+		boneJoints.push_back(bones[i][1]);
+	}
+
+	GLCall(glGenBuffers(1, &boneBuffer));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, boneBuffer));
+	GLCall(glBufferData(GL_TEXTURE_BUFFER, boneJoints.size() * sizeof(GLint), boneJoints.data(), GL_STATIC_DRAW));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+	GLCall(glGenTextures(1, &boneTexture));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, boneTexture));
+	GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32I, boneBuffer));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, 0));
+
+	GLCall(glGenVertexArrays(1, &VAO));
+	GLCall(glGenBuffers(1, &poseBuffer));
+	GLCall(glGenTextures(1, &poseTexture));
+	allocate();
+}
+
+void MotionTrails::release()
+{
+	if (trailProgram)
+	{
+		GLCall(glDeleteVertexArrays(1, &VAO));
+		GLCall(glDeleteBuffers(1, &boneBuffer));
+		GLCall(glDeleteTextures(1, &boneTexture));
+		GLCall(glDeleteBuffers(1, &poseBuffer));
+		GLCall(glDeleteTextures(1, &poseTexture));
+		trailProgram = 0;
+		ghostProgram = 0;
+		VAO = 0;
+		boneBuffer = 0;
+		boneTexture = 0;
+		poseBuffer = 0;
+		poseTexture = 0;
+	}
+
+	clear();
+}
+
+// Storage for the rings of every slot, the history starts over
+void MotionTrails::allocate()
+{
+	clear();
+
+	GLsizeiptr size = (GLsizeiptr)TRAIL_SLOT_COUNT * poseCount * SKELETON_JOINT_COUNT * sizeof(SkeletonJoint);
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, poseBuffer));
+	GLCall(glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_DYNAMIC_DRAW));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, poseTexture));
+	GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, poseBuffer));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, 0));
+}
+
+void MotionTrails::setPoseCount(int poseCount)
+{
+	poseCount = (std::max)(2, (std::min)(poseCount, TRAIL_MAX_POSES));
+	if (poseCount == this->poseCount)
+		return;
+
+	this->poseCount = poseCount;
+	if (trailProgram)
+		allocate();
+}
+
+void MotionTrails::push(int id, const SkeletonJoint* joints, const float* color)
+{
+	if (!trailProgram)
+		return;
+
+	auto found = slotIDs.find(id);
+	if (found == slotIDs.end())
+	{
+		// First free slot, skeletons beyond TRAIL_SLOT_COUNT get no trail
+		int slot = 0;
+		while (slot < TRAIL_SLOT_COUNT && slots[slot].count > 0)
+			slot++;
+		if (slot == TRAIL_SLOT_COUNT)
+			return;
+
+		slots[slot].head = poseCount - 1;
+		slots[slot].count = 0;
+		found = slotIDs.insert(std::make_pair(id, slot)).first;
+	}
+
+	Slot& slot = slots[found->second];
+	slot.head = (slot.head + 1) % poseCount;
+	slot.count = (std::min)(slot.count + 1, poseCount);
+	memcpy(slot.color, color, sizeof(slot.color));
+
+	// Overwrites the oldest pose, the driver keeps the copy a frame in flight still reads
+	GLintptr offset = ((GLintptr)found->second * poseCount + slot.head) * SKELETON_JOINT_COUNT * sizeof(SkeletonJoint);
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, poseBuffer));
+	GLCall(glBufferSubData(GL_TEXTURE_BUFFER, offset, SKELETON_JOINT_COUNT * sizeof(SkeletonJoint), joints));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
+
+void MotionTrails::push(int id, const std::vector<tdv::nuitrack::Joint>& joints, const float* color)
+{
+	SkeletonJoint converted[SKELETON_JOINT_COUNT];
+	for (int i = 0; i < SKELETON_JOINT_COUNT; i++)
+	{
+		converted[i].x = joints[i].proj.x;
+		converted[i].y = joints[i].proj.y;
+		converted[i].confidence = joints[i].confidence;
+		converted[i].unused = 0.0f;
+	}
+
+	push(id, converted, color);
+}
+
+void MotionTrails::remove(int id)
+{
+	auto found = slotIDs.find(id);
+	if (found == slotIDs.end())
+		return;
+
+	slots[found->second].count = 0;
+	slotIDs.erase(found);
+}
+
+void MotionTrails::clear()
+{
+	slotIDs.clear();
+	memset(slots, 0, sizeof(slots));
+}
+
+void MotionTrails::render(float lineWidth, int ghostCount)
+{
+	if (slotIDs.empty())
+		return;
+
+	ghostCount = (std::min)(ghostCount, TRAIL_MAX_GHOSTS);
+
+	GLint rings[TRAIL_SLOT_COUNT * 2];
+	GLfloat colors[TRAIL_SLOT_COUNT * 4];
+	for (int i = 0; i < TRAIL_SLOT_COUNT; i++)
+	{
+		rings[i * 2] = slots[i].head;
+		rings[i * 2 + 1] = slots[i].count;
+		memcpy(colors + i * 4, slots[i].color, sizeof(slots[i].color));
+	}
+
+	GLint viewport[4];
+	GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+
+	GLCall(glActiveTexture(GL_TEXTURE2));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, poseTexture));
+	GLCall(glActiveTexture(GL_TEXTURE3));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, boneTexture));
+	GLCall(glActiveTexture(GL_TEXTURE0));
+
+	GLCall(glEnable(GL_BLEND));
+	GLCall(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+	GLCall(glBindVertexArray(VAO));
+
+	// Unused slots have no poses and are culled in the vertex shaders
+	if (ghostCount > 0)
+	{
+		GLCall(glUseProgram(ghostProgram));
+		GLCall(glUniform1i(ghostPoseCountUniformLocation, poseCount));
+		GLCall(glUniform2iv(ghostRingsUniformLocation, TRAIL_SLOT_COUNT, rings));
+		GLCall(glUniform4fv(ghostColorsUniformLocation, TRAIL_SLOT_COUNT, colors));
+		GLCall(glUniform2f(ghostViewportSizeUniformLocation, (float)viewport[2], (float)viewport[3]));
+		GLCall(glUniform1f(ghostHalfWidthUniformLocation, lineWidth * 0.25f));
+		GLCall(glUniform1i(ghostCountUniformLocation, ghostCount));
+		GLCall(glUniform1i(ghostBoneCountUniformLocation, boneCount));
+		GLCall(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, TRAIL_SLOT_COUNT * ghostCount * boneCount));
+	}
+
+	GLCall(glUseProgram(trailProgram));
+	GLCall(glUniform1i(trailPoseCountUniformLocation, poseCount));
+	GLCall(glUniform2iv(trailRingsUniformLocation, TRAIL_SLOT_COUNT, rings));
+	GLCall(glUniform4fv(trailColorsUniformLocation, TRAIL_SLOT_COUNT, colors));
+	GLCall(glUniform2f(trailViewportSizeUniformLocation, (float)viewport[2], (float)viewport[3]));
+	GLCall(glUniform1f(trailHalfWidthUniformLocation, lineWidth * 0.5f));
+	GLCall(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, TRAIL_SLOT_COUNT * TRAIL_JOINT_COUNT * (poseCount - 1)));
+
+	GLCall(glBindVertexArray(0));
+	GLCall(glUseProgram(0));
+	GLCall(glDisable(GL_BLEND));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "opgl.h"
+#include "SkeletonRenderer.h"
+
+#include <nuitrack/Nuitrack.h>
+#include <vector>
+#include <map>
+
+#define TRAIL_SLOT_COUNT 8 // Skeletons with a history at once, the users and the trainer
+#define TRAIL_MAX_POSES 120
+#define TRAIL_JOINT_COUNT 6 // Joints that leave a trail, the hands, knees and ankles
+#define TRAIL_MAX_GHOSTS 8
+
+// Where the joints of every skeleton have been over the last poses, drawn as fading trails behind
+// the hands, knees and ankles and as faint ghost skeletons of earlier poses.
+// The history lives on the GPU in one texture buffer, a ring of poses per skeleton. A new pose
+// overwrites the oldest one of its ring, so a frame uploads one pose per skeleton and never the
+// history. The vertex shaders find the poses of every trail segment and ghost bone from the ring
+// heads, the same way the skeleton overlay places its bones, with one instanced draw for all
+// trails and one for all ghosts.
+class MotionTrails
+{
+public:
+	MotionTrails();
+
+	// Needs a current GL context, bones are pairs of joint indices
+	void init(const int (*bones)[2], int boneCount);
+	void release();
+
+	// History length in poses, up to TRAIL_MAX_POSES. Changing it forgets every trail
+	void setPoseCount(int poseCount);
+	int getPoseCount() const { return poseCount; }
+
+	// Appends the newest pose of a skeleton, colour is RGBA
+	void push(int id, const SkeletonJoint* joints, const float* color);
+	void push(int id, const std::vector<tdv::nuitrack::Joint>& joints, const float* color);
+	void remove(int id);
+	void clear();
+
+	// Width in pixels, ghosts are spread evenly over the history
+	void render(float lineWidth, int ghostCount);
+
+private:
+	struct Slot
+	{
+		int head; // Pose written last
+		int count; // Poses written, up to poseCount
+		float color[4];
+	};
+
+	int trailProgram;
+	int ghostProgram;
+	GLuint VAO; // Empty, the corners come from gl_VertexID
+	GLuint boneBuffer;
+	GLuint boneTexture;
+	GLuint poseBuffer;
+	GLuint poseTexture;
+	int boneCount;
+	int poseCount;
+
+	std::map<int, int> slotIDs; // Skeleton ID to slot
+	Slot slots[TRAIL_SLOT_COUNT];
+
+	int trailPoseCountUniformLocation;
+	int trailRingsUniformLocation;
+	int trailColorsUniformLocation;
+	int trailViewportSizeUniformLocation;
+	int trailHalfWidthUniformLocation;
+	int ghostPoseCountUniformLocation;
+	int ghostRingsUniformLocation;
+	int ghostColorsUniformLocation;
+	int ghostViewportSizeUniformLocation;
+	int ghostHalfWidthUniformLocation;
+	int ghostCountUniformLocation;
+	int ghostBoneCountUniformLocation;
+
+	void allocate();
+};
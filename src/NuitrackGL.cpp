@@ -1,24 +1,31 @@
-#define M_PI 3.14159265358979323846
-#define CORRECTNESS_THRESHOLD 80
+#define CORRECTNESS_THRESHOLD 80 // Alignment cost over all 19 angles
+#define TRAINER_TRAIL_ID 0 // Nuitrack skeleton IDs start at 1
 
 #include "NuitrackGL.h"
 
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 #include "UserInteraction.h"
 #include "DiskHelper.h"
+#include "ShaderManager.h"
 
 NuitrackGL::NuitrackGL() :
 	_textureID(0),
-	_textureBuffer(0),
 	_width(640),
 	_height(480),
+	_workers(2),
+	_frameTasks(_workers),
 	_isInitialized(false)
 {
 	record.store(false);
 	saving.store(false);
+	saveRequested.store(false);
 	replay.store(false);
+	session.store(false);
+	memset(loadedDataSmoothness, 0, sizeof(loadedDataSmoothness));
 }
 
 NuitrackGL::~NuitrackGL()
@@ -44,6 +51,47 @@ std::string toString(tdv::nuitrack::device::ActivationStatus status)
 	}
 }
 
+const int skeletonBones[BONE_COUNT][2] = {
+	{ tdv::nuitrack::JOINT_HEAD, tdv::nuitrack::JOINT_NECK },
+	{ tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR },
+	{ tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_TORSO },
+	{ tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_LEFT_SHOULDER },
+	{ tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_RIGHT_SHOULDER },
+	{ tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_LEFT_HIP },
+	{ tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_RIGHT_HIP },
+	{ tdv::nuitrack::JOINT_TORSO, tdv::nuitrack::JOINT_WAIST },
+	{ tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW },
+	{ tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST },
+	{ tdv::nuitrack::JOINT_LEFT_WRIST, tdv::nuitrack::JOINT_LEFT_HAND },
+	{ tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW },
+	{ tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST },
+	{ tdv::nuitrack::JOINT_RIGHT_WRIST, tdv::nuitrack::JOINT_RIGHT_HAND },
+	{ tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_RIGHT_KNEE },
+	{ tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_LEFT_KNEE },
+	{ tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_ANKLE },
+	{ tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_ANKLE }
+};
+
+// Every session gets files of its own, named after the time it started: session_20240131_154502
+static std::string getSessionName(std::time_t time)
+{
+	char name[32];
+	strftime(name, sizeof(name), "session_%Y%m%d_%H%M%S", localtime(&time));
+	return name;
+}
+
+// Keyframes are stored next to the recording, test.txt -> test.keyframes
+static std::string getKeyframesPath(const std::string& path)
+{
+	// A dot in a directory name is not an extension
+	size_t name = path.find_last_of("/\\");
+	size_t extension = path.find_last_of('.');
+	if (extension != std::string::npos && name != std::string::npos && extension < name)
+		extension = std::string::npos;
+
+	return path.substr(0, extension) + ".keyframes";
+}
+
 /*
 * Shaders are written in GLSL. They are programs that run on the GPU.
 * They are responsible for converting raw data (vertices, indices and textures) into coloured pixels.
@@ -59,31 +107,83 @@ const char* vertexShaderSource = "#version 330 core\n"
 "   TexCoord = aTexCoord;\n"
 "}\n\0";
 
+// The label map holds the user ID of every pixel, 0 is background
 const char* fragmentShaderSource = "#version 330 core\n"
 "out vec4 FragColor;\n"
 "in vec2 TexCoord;\n"
 "uniform sampler2D ourTexture;\n"
-"void main()\n"
+"uniform usampler2D labelTexture;\n"
+"uniform int segmentationMode;\n"
+"vec3 userColor(uint id)\n"
 "{\n"
-"   FragColor = texture(ourTexture, TexCoord);\n"
-"}\n\0";
-
-const char* vertexShaderSource2 = "#version 330 core\n"
-"uniform float pointSize;\n"
-"layout (location = 0) in vec2 aPos;\n"
+"   float hue = fract(float(id) * 0.618034);\n"
+"   return clamp(abs(fract(hue + vec3(0.0, 2.0 / 3.0, 1.0 / 3.0)) * 6.0 - 3.0) - 1.0, 0.0, 1.0);\n"
+"}\n"
+"uint getLabel(ivec2 texel, ivec2 size)\n"
+"{\n"
+"   return texelFetch(labelTexture, clamp(texel, ivec2(0), size - 1), 0).r;\n"
+"}\n"
 "void main()\n"
 "{\n"
-"   gl_Position = vec4(aPos, 1.0, 1.0);\n"
-"	gl_PointSize = pointSize;\n"
+"   vec4 color = texture(ourTexture, TexCoord);\n"
+"   if (segmentationMode != 0)\n"
+"   {\n"
+"       ivec2 size = textureSize(labelTexture, 0);\n"
+"       ivec2 texel = ivec2(TexCoord * vec2(size));\n"
+"       uint label = getLabel(texel, size);\n"
+"       if (segmentationMode == 1 && label != 0u)\n"
+"           color.rgb = mix(color.rgb, userColor(label), 0.4);\n"
+"       else if (segmentationMode == 2 && label != 0u)\n"
+"       {\n"
+"           bool edge = getLabel(texel + ivec2(1, 0), size) != label || getLabel(texel - ivec2(1, 0), size) != label ||\n"
+"               getLabel(texel + ivec2(0, 1), size) != label || getLabel(texel - ivec2(0, 1), size) != label;\n"
+"           if (edge)\n"
+"               color.rgb = userColor(label);\n"
+"       }\n"
+"       else if (segmentationMode == 3 && label == 0u)\n"
+"           color.rgb *= 0.25;\n"
+"   }\n"
+"   FragColor = color;\n"
 "}\n\0";
 
-const char* fragmentShaderSource2 = "#version 330 core\n"
+// Same colour as userColor in the fragment shader, RGBA
+static void getUserColor(int id, float* color)
+{
+	float hue = id * 0.618034f;
+	hue -= std::floor(hue);
+
+	const float offsets[3] = { 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	for (int i = 0; i < 3; i++)
+	{
+		float channel = hue + offsets[i];
+		channel = std::fabs((channel - std::floor(channel)) * 6.0f - 3.0f) - 1.0f;
+		color[i] = (std::min)((std::max)(channel, 0.0f), 1.0f);
+	}
+	color[3] = 1.0f;
+}
+
+// Depth in mm is stored normalized in an R16 texture, 0 means no depth.
+// With turboColormapSource in between the version line and the body.
+const char* fragmentShaderDepthSource[3] = {
+"#version 330 core\n",
+turboColormapSource,
 "out vec4 FragColor;\n"
-"uniform vec4 color;\n"
+"in vec2 TexCoord;\n"
+"uniform sampler2D depthTexture;\n"
+"uniform vec2 depthRange;\n"
 "void main()\n"
 "{\n"
-"   FragColor = color;\n"
-"}\n\0";
+"   float depth = texture(depthTexture, TexCoord).r * 65535.0;\n"
+"   if (depth == 0.0)\n"
+"       FragColor = vec4(0.0, 0.0, 0.0, 1.0);\n"
+"   else\n"
+"       FragColor = vec4(turbo((depth - depthRange.x) / (depthRange.y - depthRange.x)), 1.0);\n"
+"}\n" };
+
+static const ShaderProgramSource imageProgramSource = { "image", &vertexShaderSource, 1, &fragmentShaderSource, 1 };
+static const ShaderProgramSource depthProgramSource = { "image_depth", &vertexShaderSource, 1, fragmentShaderDepthSource, 3 };
+static ShaderRegistration imageRegistration(imageProgramSource);
+static ShaderRegistration depthRegistration(depthProgramSource);
 
 void NuitrackGL::init(const std::string& config)
 {
@@ -139,6 +239,8 @@ void NuitrackGL::init(const std::string& config)
 	_depthSensor = tdv::nuitrack::DepthSensor::create();
 	_colorSensor = tdv::nuitrack::ColorSensor::create();
 	_colorSensor->connectOnNewFrame(std::bind(&NuitrackGL::onNewRGBFrame, this, std::placeholders::_1));
+	_depthSensor->connectOnNewFrame(std::bind(&NuitrackGL::onNewDepthFrame, this, std::placeholders::_1));
+	_depthOutputMode = _depthSensor->getOutputMode();
 
 	_outputMode = _colorSensor->getOutputMode();
 	_width = _outputMode.xres;
@@ -147,20 +249,28 @@ void NuitrackGL::init(const std::string& config)
 	_userTracker = tdv::nuitrack::UserTracker::create();
 	_userTracker->connectOnNewUser(std::bind(&NuitrackGL::onNewUserCallback, this, std::placeholders::_1));
 	_userTracker->connectOnLostUser(std::bind(&NuitrackGL::onLostUserCallback, this, std::placeholders::_1));
+	_userTracker->connectOnUpdate(std::bind(&NuitrackGL::onUserUpdate, this, std::placeholders::_1));
 
 	_skeletonTracker = tdv::nuitrack::SkeletonTracker::create();
 	_skeletonTracker->connectOnUpdate(std::bind(&NuitrackGL::onSkeletonUpdate, this, std::placeholders::_1));
 
 	_onIssuesUpdateHandler = tdv::nuitrack::Nuitrack::connectOnIssuesUpdate(std::bind(&NuitrackGL::onIssuesUpdate, this, std::placeholders::_1));
+
+	DiskHelper::readStatisticsFromDisk("history.stats", historyStatistics);
 }
 
 bool NuitrackGL::update(float* skeletonColor, float* jointColor, const float& pointSize, const float& lineWidth, const bool& overrideJointColour)
 {
 	if (!_isInitialized)
 	{
-		// Create texture by DepthSensor output mode
-		initTexture(_width, _height);
-		initLines();
+		// The textures are allocated by the streamers with the first frame they upload
+		initTexture();
+		initDepthTexture();
+		_pointCloudRenderer.init();
+		_skeletonRenderer.init(skeletonBones, BONE_COUNT);
+		_skeletonViewport.init(skeletonBones, BONE_COUNT);
+		_motionTrails.init(skeletonBones, BONE_COUNT);
+		_motionTrails.setPoseCount(_trailPoseCount);
 
 		// When Nuitrack modules are created, we need to call Nuitrack::run() to start processing all modules
 		try
@@ -175,67 +285,126 @@ bool NuitrackGL::update(float* skeletonColor, float* jointColor, const float& po
 		}
 		_isInitialized = true;
 	}
-	try
+
+	bool isReplay = false;
+	TaskGraph::TaskID trainerTask = -1;
+	if (replay.load())
 	{
-		std::thread replayLoader;
-		bool isReplay = false;
-		if (replay.load())
+		if (replayPointer < readJointDataBuffer.size())
 		{
-			if (replayPointer < readJointDataBuffer.size())
+			isReplay = true;
+			// Loaded while the textures are uploaded, only when the replay moved on
+			if (replayPointer != loadedTrainerFrame)
 			{
-				isReplay = true;
-				replayLoader = std::thread(&NuitrackGL::updateTrainerSkeleton, this);
-			}
-			else {
-				replay.store(false);
+				loadedTrainerFrame = replayPointer;
+				trainerTask = _frameTasks.add(std::bind(&NuitrackGL::updateTrainerSkeleton, this));
 			}
 		}
-		tdv::nuitrack::Nuitrack::waitUpdate(_skeletonTracker);
-		if (isReplay)
-			replayLoader.join();
-		// Set next frame here
-		
-		//Calculate Angle correctness
-		if (isReplay && hasAllJoints)
+		else {
+			replay.store(false);
+			if (session.load())
+				stopSession();
+		}
+	}
+
+	tdv::nuitrack::SkeletonData::Ptr skeletons = _newSkeletons;
+	double skeletonTime = _newSkeletonTime;
+	bool hasNewSkeleton = (bool)skeletons;
+	_newSkeletons.reset();
+
+	// The skeletons go through the stages on the worker pool, a stage starts once the stages it
+	// reads from are done. Scoring runs beside the patient analytics, and the texture upload on
+	// this thread overlaps all of them. The render only waits for the users and the joints it draws,
+	// the analytics, scoring and the replay run on while ingest() receives the next frames.
+	TaskGraph::TaskID anglesTask = -1;
+	if (hasNewSkeleton)
+	{
+		anglesTask = _frameTasks.add([this, skeletons, skeletonTime]
 		{
+			updateUsers(skeletons->getSkeletons(), skeletonTime);
+		});
 
-			if (replayPointer % 30 == 0)
-			{
-				int correctness = 0;
-
-				for (int i = 0; i < 19; i++)
-				{
-					correctness += abs(userAngles[i] - readJointDataBuffer[replayPointer].angles[i]); // Manhattan distance 
-				}
-				std::cout << "Correctness result: " << correctness << std::endl;
-
-				if (correctness < CORRECTNESS_THRESHOLD)
-				{
-					replayPointer++;
-				}
-			}
-			else {
-				replayPointer++;
-			}
+		TaskGraph::TaskID analyticsTask = _frameTasks.add([this, skeletons, skeletonTime]
+		{
+			const TrackedUser* patient = getPatientUser();
+			if (patient && patient->hasAllJoints)
+				updatePatient(*patient, skeletons->getTimestamp(), skeletonTime);
+		}, { anglesTask });
+
+		if (isReplay)
+		{
+			TaskGraph::TaskID scoreTask = _frameTasks.add(std::bind(&NuitrackGL::scoreUsers, this), { anglesTask });
+			// The session records the frame the analytics just filled in
+			_frameTasks.add(std::bind(&NuitrackGL::advanceReplay, this), { scoreTask, analyticsTask });
 		}
+	}
+
+	// Picked before the prediction is queued, it predicts to the time of the frames that are shown
+	updateFrameBundle();
+	TaskGraph::TaskID drawnTask = _frameTasks.add(std::bind(&NuitrackGL::updateUserSkeleton, this), { anglesTask });
+
+	renderTexture();
+	_frameTasks.wait({ anglesTask, drawnTask, trainerTask });
+
+	// Trails are GL objects, the users that left are only noted by the stages
+	for (int id : _removedUsers)
+		_motionTrails.remove(id);
+	_removedUsers.clear();
+
+	// One pose per sensor frame, so the trails cover the same time at any display rate
+	if (hasNewSkeleton)
+		updateMotionTrails(skeletonColor, isReplay, overrideJointColour);
 
-		renderTexture();
-		renderLinesUser(skeletonColor, jointColor, pointSize, lineWidth, _lines, numLines, true, overrideJointColour);
-		renderLinesTrainer(skeletonColor, jointColor, pointSize, lineWidth, _lines2, numLines2, replay.load(), overrideJointColour);
+	// The skeleton lines are in image coordinates and do not match the 3D view
+	if (_viewMode != POINT_CLOUD_MODE)
+		renderSkeletons(skeletonColor, jointColor, pointSize, lineWidth, isReplay, overrideJointColour);
+	if (_showSkeletonView)
+		renderSkeletonView(isReplay);
+
+	return true;
+}
+
+bool NuitrackGL::ingest()
+{
+	// Nuitrack is started by the first update
+	if (!_isInitialized)
+		return true;
+
+	try
+	{
+		// Non-blocking so the render loop runs at display refresh, the skeleton is predicted in between sensor frames.
+		// The callbacks only hand the frames over, the stages of the last frame can still be running.
+		tdv::nuitrack::Nuitrack::update(_skeletonTracker);
 	}
 	catch (const tdv::nuitrack::LicenseNotAcquiredException& e)
 	{
+		_frameTasks.wait();
 		// Update failed, negative result
 		std::cerr << "LicenseNotAcquired exception (ExceptionType: " << e.type() << ")" << std::endl;
 		return false;
 	}
 	catch (const tdv::nuitrack::Exception& e)
 	{
+		_frameTasks.wait();
 		// Update failed, negative result
 		std::cerr << "Nuitrack update failed (ExceptionType: " << e.type() << ")" << std::endl;
 		return false;
 	}
-	
+
+	_frameTasks.wait();
+
+	// The balance estimator is no longer in use by the analytics
+	if (_newUserFrame)
+	{
+		const tdv::nuitrack::Vector3 floor = _newUserFrame->getFloor();
+		const tdv::nuitrack::Vector3 floorNormal = _newUserFrame->getFloorNormal();
+		balanceEstimator.setFloor(floor.x, floor.y, floor.z, floorNormal.x, floorNormal.y, floorNormal.z);
+		_newUserFrame.reset();
+	}
+
+	if (saveRequested.exchange(false))
+		saveBufferToDisk();
+
 	return true;
 }
 
@@ -244,6 +413,21 @@ void NuitrackGL::release()
 	if (_onIssuesUpdateHandler)
 		tdv::nuitrack::Nuitrack::disconnectOnIssuesUpdate(_onIssuesUpdateHandler);
 
+	// The stages of the last frame may still be running
+	_frameTasks.wait();
+
+	// Let go of the buffered frames before the modules they came from
+	_frameBundle = FrameBundle();
+	_frameSynchronizer.clear();
+
+	if (sessionWriterThread.joinable())
+		sessionWriterThread.join();
+
+	if (saveRequested.exchange(false))
+		saveBufferToDisk();
+	if (recordingWriterThread.joinable())
+		recordingWriterThread.join();
+
 	// Release Nuitrack and remove all modules
 	try
 	{
@@ -254,27 +438,87 @@ void NuitrackGL::release()
 		std::cerr << "Nuitrack release failed (ExceptionType: " << e.type() << ")" << std::endl;
 	}
 
+	_colorStreamer.release();
+	_depthStreamer.release();
+	_labelStreamer.release();
+	_pointCloudRenderer.release();
+	_skeletonRenderer.release();
+	_skeletonViewport.release();
+	_motionTrails.release();
 	_isInitialized = false;
-	// Free texture buffer
-	if (_textureBuffer)
-	{
-		delete[] _textureBuffer;
-		_textureBuffer = 0;
-	}
 }
 
 void NuitrackGL::loadDataToBuffer(const std::string& path)
 {
 	DiskHelper::readDatafromDisk(path, readJointDataBuffer);
+	loadedDataPath = path;
+	loadedTrainerFrame = -1;
+
+	DiskHelper::readKeyframesFromDisk(getKeyframesPath(path), keyframes);
+	closestKeyframe = -1;
+
+	// Keyframes from an older recording under the same name
+	for (const Keyframe& keyframe : keyframes)
+	{
+		if (keyframe.frame >= (int)readJointDataBuffer.size())
+		{
+			keyframes.clear();
+			break;
+		}
+	}
+}
+
+void NuitrackGL::extractKeyframes(int count)
+{
+	if (readJointDataBuffer.empty())
+	{
+		std::cout << "Load trainer data before extracting keyframes" << std::endl;
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	KeyframeExtractor::extract(readJointDataBuffer, count, keyframes);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << "Extracted " << keyframes.size() << " keyframes from " << readJointDataBuffer.size() << " frames in " << elapsed.count() << " s" << std::endl;
+
+	closestKeyframe = -1;
+	DiskHelper::writeKeyframesToDisk(getKeyframesPath(loadedDataPath), keyframes);
 }
 
+void NuitrackGL::previewKeyframe(int index)
+{
+	if (index < 0 || index >= (int)keyframes.size())
+		return;
+
+	replayPointer = keyframes[index].frame;
+	replay.store(true);
+}
+
+// Called between frames, where nothing adds to the buffer or the statistics
 void NuitrackGL::saveBufferToDisk()
 {
+	if (recordingWriterThread.joinable())
+		recordingWriterThread.join();
+
+	// The thread gets copies made here, the digests compress when they are written
 	jointDataBufferMutex.lock();
+	recordingWriterThread = std::thread(&NuitrackGL::writeRecording, this, writeJointDataBuffer, angleStatistics);
+	jointDataBufferMutex.unlock();
+}
 
-	DiskHelper::writeDataToDisk("test.txt", writeJointDataBuffer);
+void NuitrackGL::writeRecording(std::vector<JointFrame> frames, AngleStatistics statistics)
+{
+	std::cout << "Saving data to disk" << std::endl;
+	DiskHelper::writeDataToDisk("test.txt", frames);
+	DiskHelper::writeStatisticsToDisk("test.stats", statistics);
+	saving.store(false);
+	std::cout << "Data saved to disk" << std::endl << std::endl;
+}
 
-	jointDataBufferMutex.unlock();
+void NuitrackGL::analyzeLoadedData()
+{
+	batchSmoothnessAnalyzer.analyzeRecording(readJointDataBuffer, loadedDataSmoothness);
 }
 
 void NuitrackGL::playLoadedData()
@@ -283,96 +527,106 @@ void NuitrackGL::playLoadedData()
 	replay.store(true);
 }
 
-void NuitrackGL::stopRecording()
+void NuitrackGL::startSession()
 {
-	if (record.load() && !saving.load())
+	if (readJointDataBuffer.empty())
 	{
-		saving.store(true);
-		record.store(false);
-		// Start a thread that saves the data from the recorded buffer.
-		std::cout << "Saving data to disk" << std::endl;
-		std::thread writerThread (&NuitrackGL::saveBufferToDisk, this);
-		writerThread.join();
-		saving.store(false);
-		std::cout << "Data saved to disk" << std::endl << std::endl;
+		std::cout << "Load trainer data before starting a session" << std::endl;
+		return;
 	}
-	else 
+
+	if (session.load())
 	{
-		std::cout << "Invalid operation" << std::endl;
+		std::cout << "A session is already in progress" << std::endl;
+		return;
 	}
-}
 
-void NuitrackGL::stopRecordingTimer(const int& duration)
-{
-	std::this_thread::sleep_for(std::chrono::seconds(duration));
-	std::cout << "Stopping recording" << std::endl;
-	stopRecording();
+	sessionName = getSessionName(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+	std::cout << std::endl << "Starting " << sessionName << std::endl;
+	sessionBuffer.clear();
+	angleStatistics.clear();
+	symmetryAnalyzer.clear();
+	balanceEstimator.clear();
+	smoothnessAnalyzer.clear();
+	session.store(true);
+	playLoadedData();
 }
 
-int NuitrackGL::get2DAngleABC(const JointFrame& jointFrame, int a_index, int b_index, int c_index)
+void NuitrackGL::stopSession()
 {
-	const Vector2& a = jointFrame.joints[a_index];
-	const Vector2& b = jointFrame.joints[b_index];
-	const Vector2& c = jointFrame.joints[b_index];
-
-	Vector2 ab = { b.x - a.x, b.y - a.y };
-	Vector2 cb = { b.x - c.x, b.y - c.y };
-
-	float dot = (ab.x * cb.x + ab.y * cb.y);
-	float cross = (ab.x * cb.y - ab.y * cb.x);
+	session.store(false);
 
-	float alpha = atan2(cross, dot);
+	// One session is written at a time
+	if (sessionWriterThread.joinable())
+		sessionWriterThread.join();
 
-	int retVal = (int)floor(alpha * 180. / M_PI + 0.5);
-
-	if (retVal < 0)
-		retVal = 360 + retVal;
-
-	return retVal;
+	// The thread gets copies made here, the frames stay in memory for the export
+	sessionWriterThread = std::thread(&NuitrackGL::writeSession, sessionName, sessionBuffer, angleStatistics);
 }
 
-int NuitrackGL::get3DAngleABC(const JointFrame& jointFrame, int a_index, int b_index, int c_index)
+void NuitrackGL::writeSession(std::string name, std::vector<SessionFrame> frames, AngleStatistics statistics)
 {
-	const Vector2& a = jointFrame.joints[a_index];
-	const Vector2& b = jointFrame.joints[b_index];
-	const Vector2& c = jointFrame.joints[b_index];
-
-	Vector2 ab = { b.x - a.x, b.y - a.y };
-	Vector2 cb = { b.x - c.x, b.y - c.y };
-
-	float dot = (ab.x * cb.x + ab.y * cb.y);
-	float cross = (ab.x * cb.y - ab.y * cb.x);
-
-	float alpha = atan2(cross, dot);
-
-	int retVal = (int)floor(alpha * 180. / M_PI + 0.5);
-
-	if (retVal < 0)
-		retVal = 360 + retVal;
+	std::cout << "Saving session to " << name << ".txt" << std::endl;
+	DiskHelper::writeSessionToDisk(name + ".txt", frames);
+	DiskHelper::writeStatisticsToDisk(name + ".stats", statistics);
+	std::cout << "Session saved to disk" << std::endl << std::endl;
+}
 
-	return retVal;
+void NuitrackGL::addStatisticsToHistory()
+{
+	// Re-read the history in case another session was added since start up
+	DiskHelper::readStatisticsFromDisk("history.stats", historyStatistics);
+	historyStatistics.merge(angleStatistics);
+	DiskHelper::writeStatisticsToDisk("history.stats", historyStatistics);
+	std::cout << "Statistics added to history" << std::endl;
 }
 
-int NuitrackGL::get3DAngleABC(const std::vector<tdv::nuitrack::Joint>& joints, int a_index, int b_index, int c_index)
+void NuitrackGL::setScoringMask(uint32_t mask)
 {
-	const tdv::nuitrack::Joint& a = joints[a_index];
-	const tdv::nuitrack::Joint& b = joints[b_index];
-	const tdv::nuitrack::Joint& c = joints[c_index];
+	scoringMask = mask & ENGINE_ALL_ANGLES;
 
-	Vector2 ab = { b.proj.x - a.proj.x, b.proj.y - a.proj.y };
-	Vector2 cb = { b.proj.x - c.proj.x, b.proj.y - c.proj.y };
+	scoringAngleCount = 0;
+	for (int i = 0; i < ENGINE_ANGLE_COUNT; i++)
+	{
+		if (scoringMask & (1u << i))
+			scoringAngleCount++;
+	}
+}
 
-	float dot = (ab.x * cb.x + ab.y * cb.y);
-	float cross = (ab.x * cb.y - ab.y * cb.x);
+int NuitrackGL::getAlignmentCost(const int* angles, const JointFrame& trainerFrame)
+{
+	int cost = 0;
 
-	float alpha = atan2(cross, dot);
+	for (int i = 0; i < 19; i++)
+	{
+		// Only the angles the exercise uses are compared
+		if (scoringMask & (1u << i))
+			cost += abs(angles[i] - trainerFrame.angles[i]); // Manhattan distance
+	}
 
-	int retVal = (int)floor(alpha * 180. / M_PI + 0.5);
+	return cost;
+}
 
-	if (retVal < 0)
-		retVal = 360 + retVal;
+void NuitrackGL::stopRecording()
+{
+	if (record.load() && !saving.load())
+	{
+		saving.store(true);
+		record.store(false);
+		// Saved by the next update, the analytics may still be adding the last frame
+		saveRequested.store(true);
+	}
+	else 
+	{
+		std::cout << "Invalid operation" << std::endl;
+	}
+}
 
-	return retVal;
+void NuitrackGL::stopRecordingTimer(const int& duration)
+{
+	std::this_thread::sleep_for(std::chrono::seconds(duration));
+	std::cout << "Stopping recording" << std::endl;
+	stopRecording();
 }
 
 void NuitrackGL::startRecording(const int& duration)
@@ -384,6 +638,10 @@ void NuitrackGL::startRecording(const int& duration)
 	else {
 		std::cout << std::endl << "Starting video recording" << std::endl;
 		writeJointDataBuffer.clear();
+		angleStatistics.clear();
+		symmetryAnalyzer.clear();
+		balanceEstimator.clear();
+		smoothnessAnalyzer.clear();
 		record.store(true);
 		std::thread timerThread(&NuitrackGL::stopRecordingTimer, this, duration);
 		timerThread.detach();
@@ -402,6 +660,21 @@ void NuitrackGL::onNewUserCallback(int id)
 	std::cout << "New User " << id << std::endl;
 }
 
+void NuitrackGL::onUserUpdate(tdv::nuitrack::UserFrame::Ptr frame)
+{
+	const tdv::nuitrack::Vector3 floor = frame->getFloor();
+	const tdv::nuitrack::Vector3 floorNormal = frame->getFloorNormal();
+
+	// The analytics of the last frame can still be running, the balance estimator gets the floor in ingest()
+	_newUserFrame = frame;
+
+	const float floorPoint[3] = { floor.x, floor.y, floor.z };
+	const float floorDirection[3] = { floorNormal.x, floorNormal.y, floorNormal.z };
+	_skeletonViewport.setFloor(floorPoint, floorDirection);
+
+	_frameSynchronizer.addUser(frame);
+}
+
 void NuitrackGL::onIssuesUpdate(tdv::nuitrack::IssuesData::Ptr issuesData)
 {
 	_issuesData = issuesData;
@@ -413,149 +686,219 @@ void NuitrackGL::onNewRGBFrame(tdv::nuitrack::RGBFrame::Ptr frame)
 	//std::thread::id this_id = std::this_thread::get_id();
 	//std::cout << "RGB update thread: " << this_id << std::endl;
 
-	// Storing from end of the buffer to start because frame data is received from top to bottom
-	// OpenGl requires texture data from the bottom to top.
-	// This will reverse the x-axis order of pixels too but it works out because image from a camera is mirrored.
-	uint8_t* texturePtr = _textureBuffer + (3 * _width * _height) - 1;
-	const tdv::nuitrack::Color3* colorPtr = frame->getData();
+	// Only publish the frame, the pixels are uploaded untouched in renderTexture.
+	// Flipping and mirroring are done with the texture coordinates and scaling by the sampler.
+	std::shared_ptr<ColorImage> image = _frameSynchronizer.acquireColorImage();
+	image->frame = frame;
+	image->isMasked = _privacyFilter.getMode() != PRIVACY_OFF;
+
+	// Everything but the patient is hidden before the frame leaves the callback, other people in the room included
+	if (image->isMasked)
+	{
+		image->masked.resize(frame->getCols() * frame->getRows() * 3);
+
+		// The label map captured with this frame, or the newest one
+		tdv::nuitrack::UserFrame::Ptr userFrame = _frameSynchronizer.getUser(frame->getTimestamp());
+
+		const uint16_t* labels = NULL;
+		int labelCols = 0;
+		int labelRows = 0;
+		if (userFrame)
+		{
+			labels = userFrame->getData();
+			labelCols = userFrame->getCols();
+			labelRows = userFrame->getRows();
+		}
+
+		// The label map uses the skeleton IDs. Nobody is shown until there is a patient.
+		const TrackedUser* patient = getPatientUser();
+		int patientID = patient ? patient->id : 0;
+
+		_privacyFilter.apply((const uint8_t*)frame->getData(), frame->getCols(), frame->getRows(), labels, labelCols, labelRows, patientID, image->masked.data());
+	}
+
+	_frameSynchronizer.addColor(image);
+}
+
+void NuitrackGL::onNewDepthFrame(tdv::nuitrack::DepthFrame::Ptr frame)
+{
+	_frameSynchronizer.addDepth(frame);
+}
+
+// Track every user in the skeleton data, received from Nuitrack
+void NuitrackGL::onSkeletonUpdate(tdv::nuitrack::SkeletonData::Ptr userSkeletons)
+{
+	_frameSynchronizer.addSkeletons(userSkeletons);
+
+	std::chrono::duration<double> time = std::chrono::steady_clock::now().time_since_epoch();
 
-	float wStep = (float)_width / frame->getCols();
-	float hStep = (float)_height / frame->getRows();
+	// The filters run on the time the sensor captured the skeleton. The callback runs whenever
+	// update() polls at display refresh, so its own time is off by up to a display frame.
+	double sensorTime = userSkeletons->getTimestamp() / 1000000.0;
+	updateSensorClockOffset(sensorTime, time.count());
 
-	//std::cout << "Output : " << frame->getCols() << std::endl << "Output rows: " << frame->getRows() << std::endl;
+	// The users are added, removed, filtered and analyzed by the frame stages in update()
+	_newSkeletons = userSkeletons;
+	_newSkeletonTime = sensorTime;
+}
 
-	float nextVerticalBorder = hStep;
+// The skeletons arrive later than they were captured by a varying amount. The smallest
+// difference between the clocks is the closest to the true offset, it is let up slowly
+// so a drift between the clocks is followed.
+void NuitrackGL::updateSensorClockOffset(double sensorTime, double renderTime)
+{
+	double offset = renderTime - sensorTime;
 
-	for (size_t i = 0; i < _height; ++i)
+	// The first skeleton, or the sensor started its clock again
+	if (!_hasSensorClockOffset || std::fabs(offset - _sensorClockOffset) > 1.0)
+	{
+		_sensorClockOffset = offset;
+		_hasSensorClockOffset = true;
+	}
+	else if (offset < _sensorClockOffset)
 	{
-		if (i == (int)nextVerticalBorder)
+		_sensorClockOffset = offset;
+	}
+	else
+	{
+		_sensorClockOffset += (offset - _sensorClockOffset) * 0.001;
+	}
+}
+
+// Every user has a pipeline of their own. They are run one after the other,
+// a user takes a few microseconds which is less than handing the work to another thread.
+// Users are only added and removed here, the first stage of a frame.
+void NuitrackGL::updateUsers(const std::vector<tdv::nuitrack::Skeleton>& skeletons, double time)
+{
+	// Forget the users that left the view
+	for (auto it = _users.begin(); it != _users.end();)
+	{
+		bool tracked = false;
+		for (const tdv::nuitrack::Skeleton& skeleton : skeletons)
 		{
-			nextVerticalBorder += hStep;
-			colorPtr += frame->getCols();
+			if (skeleton.id == it->first)
+				tracked = true;
 		}
 
-		int col = 0;
-		float nextHorizontalBorder = wStep;
-
-		for (size_t j = 0; j < _width; ++j, texturePtr -= 3)
+		if (tracked)
 		{
-			if (j == (int)nextHorizontalBorder)
-			{
-				++col;
-				nextHorizontalBorder += wStep;
-			}
+			++it;
+		}
+		else
+		{
+			_removedUsers.push_back(it->first);
+			it = _users.erase(it);
+		}
+	}
 
-			*(texturePtr - 2) = (colorPtr + col)->red;
-			*(texturePtr - 1) = (colorPtr + col)->green;
-			*(texturePtr - 0) = (colorPtr + col)->blue;
+	for (const tdv::nuitrack::Skeleton& skeleton : skeletons)
+	{
+		TrackedUser& user = _users[skeleton.id];
+		if (user.id == 0)
+		{
+			user.id = skeleton.id;
+			user.firstSeen = time;
+			user.filter.setParameters(filterMinCutoff, filterBeta, filterLatency);
 		}
+
+		updateUser(user, skeleton.joints, time);
 	}
 }
 
-// Prepare visualization of skeletons, received from Nuitrack
-void NuitrackGL::onSkeletonUpdate(tdv::nuitrack::SkeletonData::Ptr userSkeletons)
+// Filter and angles of a single user
+void NuitrackGL::updateUser(TrackedUser& user, const std::vector<tdv::nuitrack::Joint>& joints, double time)
 {
-	numLines = 0;
+	// The skeleton is complete when every bone can be drawn
+	bool hasJoints = true;
+	for (int i = 0; i < BONE_COUNT; i++)
+	{
+		if (joints[skeletonBones[i][0]].confidence <= 0.15f || joints[skeletonBones[i][1]].confidence <= 0.15f)
+			hasJoints = false;
+	}
 
-	auto skeletons = userSkeletons->getSkeletons();
+	user.hasAllJoints = hasJoints;
+	user.joints = joints;
+	user.filter.update(joints, time);
+	// Scored again if a replay is running
+	user.alignmentCost = -1;
+	user.score = -1;
 
+	if (hasJoints)
+		angleEngine.compute(joints, user.angles);
+}
 
-	for (tdv::nuitrack::Skeleton skeleton: skeletons)
+TrackedUser* NuitrackGL::getPatientUser()
+{
+	auto selected = _users.find(_patientID);
+	if (selected != _users.end())
+		return &selected->second;
+
+	// Nobody selected or the selected user left, take the one tracked the longest
+	TrackedUser* patient = NULL;
+	for (auto& entry : _users)
 	{
-		drawSkeleton(skeleton.joints);
+		if (!patient || entry.second.firstSeen < patient->firstSeen)
+			patient = &entry.second;
 	}
+
+	return patient;
 }
 
-// Helper function to draw skeleton from Nuitrack data
-void NuitrackGL::drawSkeleton(const std::vector<tdv::nuitrack::Joint>& joints)
+void NuitrackGL::setSkeletonFilterParameters(float minCutoff, float beta, float latency)
 {
-	bool hasJoints = true;
+	filterMinCutoff = minCutoff;
+	filterBeta = beta;
+	filterLatency = latency;
 
-	// We need to draw a bone for every pair of neighbour joints
-	if (!drawBone(joints[tdv::nuitrack::JOINT_HEAD], joints[tdv::nuitrack::JOINT_NECK]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_NECK], joints[tdv::nuitrack::JOINT_LEFT_COLLAR]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_COLLAR], joints[tdv::nuitrack::JOINT_TORSO]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_COLLAR], joints[tdv::nuitrack::JOINT_LEFT_SHOULDER]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_COLLAR], joints[tdv::nuitrack::JOINT_RIGHT_SHOULDER]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_WAIST], joints[tdv::nuitrack::JOINT_LEFT_HIP]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_WAIST], joints[tdv::nuitrack::JOINT_RIGHT_HIP]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_TORSO], joints[tdv::nuitrack::JOINT_WAIST]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_SHOULDER], joints[tdv::nuitrack::JOINT_LEFT_ELBOW]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_ELBOW], joints[tdv::nuitrack::JOINT_LEFT_WRIST]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_WRIST], joints[tdv::nuitrack::JOINT_LEFT_HAND]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_RIGHT_SHOULDER], joints[tdv::nuitrack::JOINT_RIGHT_ELBOW]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_RIGHT_ELBOW], joints[tdv::nuitrack::JOINT_RIGHT_WRIST]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_RIGHT_WRIST], joints[tdv::nuitrack::JOINT_RIGHT_HAND]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_RIGHT_HIP], joints[tdv::nuitrack::JOINT_RIGHT_KNEE]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_HIP], joints[tdv::nuitrack::JOINT_LEFT_KNEE]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_RIGHT_KNEE], joints[tdv::nuitrack::JOINT_RIGHT_ANKLE]))
-		hasJoints = false;
-	if (!drawBone(joints[tdv::nuitrack::JOINT_LEFT_KNEE], joints[tdv::nuitrack::JOINT_LEFT_ANKLE]))
-		hasJoints = false;
-
-	hasAllJoints = hasJoints;
-
-	if (hasJoints) {
-		userAngles[0] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_ANKLE, tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_HIP);
-		userAngles[1] = get3DAngleABC(joints, tdv::nuitrack::JOINT_RIGHT_ANKLE, tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_HIP);
-		userAngles[2] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_RIGHT_HIP);
-		userAngles[3] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_WAIST);
-		userAngles[4] = get3DAngleABC(joints, tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_WAIST);
-		userAngles[5] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_TORSO);
-		userAngles[6] = get3DAngleABC(joints, tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_TORSO);
-		userAngles[7] = get3DAngleABC(joints, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_TORSO, tdv::nuitrack::JOINT_LEFT_COLLAR); // Joint left collar same as joint right collar
-		userAngles[8] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_TORSO);
-		userAngles[9] = get3DAngleABC(joints, tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_TORSO);
-		userAngles[10] = get3DAngleABC(joints, tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_LEFT_SHOULDER);
-		userAngles[11] = get3DAngleABC(joints, tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_RIGHT_SHOULDER);
-		userAngles[12] = get3DAngleABC(joints, tdv::nuitrack::JOINT_HEAD, tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR);
-		userAngles[13] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW);
-		userAngles[14] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW);
-		userAngles[15] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST);
-		userAngles[16] = get3DAngleABC(joints, tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST);
-		userAngles[17] = get3DAngleABC(joints, tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST, tdv::nuitrack::JOINT_LEFT_HAND);
-		userAngles[18] = get3DAngleABC(joints, tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST, tdv::nuitrack::JOINT_RIGHT_HAND);
-	}
-
-	std::time_t time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-	if (record.load() && !saving.load() && hasJoints)
+	for (auto& entry : _users)
+		entry.second.filter.setParameters(minCutoff, beta, latency);
+}
+
+// Statistics, analysis and recording of the patient's complete skeletons
+void NuitrackGL::updatePatient(const TrackedUser& user, uint64_t timestamp, double time)
+{
+	const std::vector<tdv::nuitrack::Joint>& joints = user.joints;
+	const int* userAngles = user.angles;
+
+	// Read once, the timer thread can stop the recording in between. Only the frames that are
+	// saved are counted, so the statistics of a recording match its frames.
+	bool recording = record.load() && !saving.load();
+	if (recording || session.load())
+		angleStatistics.add(userAngles);
+	symmetryAnalyzer.update(userAngles);
+
+	if (!keyframes.empty())
+		closestKeyframe = KeyframeExtractor::findClosest(readJointDataBuffer, keyframes, userAngles);
+
+	// Keep the latest frame around so sessions can tag it with the trainer frame
+	JointFrame& frame = lastUserFrame;
+
+	for (int i = 0; i < 25; i++)
 	{
-		if (jointDataBufferMutex.try_lock()) {
-			JointFrame frame;
+		frame.joints[i].x = joints[i].proj.x;
+		frame.joints[i].y = joints[i].proj.y;
+		frame.confidence[i] = joints[i].confidence;
+		frame.realJoints[i].x = joints[i].real.x;
+		frame.realJoints[i].y = joints[i].real.y;
+		frame.realJoints[i].z = joints[i].real.z;
+	}
 
-			for (int i = 0; i < 25; i++)
-			{
-				frame.joints[i].x = joints[i].proj.x;
-				frame.joints[i].y = joints[i].proj.y;
-				frame.confidence[i] = joints[i].confidence;
-				frame.realJoints[i].x = joints[i].real.x;
-				frame.realJoints[i].y = joints[i].real.y;
-				frame.realJoints[i].z = joints[i].real.z;
-				
-			}
+	for (int i = 0; i < 19; i++)
+	{
+		frame.angles[i] = userAngles[i];
+	}
 
-			for (int i = 0; i < 19; i++)
-			{
-				frame.angles[i] = userAngles[i];
-			}
+	AnatomicalAngles::compute(joints, frame.anatomicalAngles);
+
+	frame.timeStamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	frame.sensorTimestamp = timestamp;
+
+	balanceEstimator.update(frame, time);
+	smoothnessAnalyzer.addFrame(frame);
 
-			frame.timeStamp = time;
+	if (recording)
+	{
+		if (jointDataBufferMutex.try_lock()) {
 			writeJointDataBuffer.push_back(frame);
 			jointDataBufferMutex.unlock();
 		}
@@ -568,328 +911,406 @@ void NuitrackGL::drawSkeleton(const std::vector<tdv::nuitrack::Joint>& joints)
 	
 }
 
-void NuitrackGL::updateTrainerSkeleton()
+void NuitrackGL::setPointCloudCamera(float yaw, float pitch, float distance, float pointSize)
 {
-	numLines2 = 0;
-
-	const JointFrame& jf = readJointDataBuffer.at(replayPointer);
+	_cloudYaw = yaw;
+	_cloudPitch = pitch;
+	_cloudDistance = distance;
+	_cloudPointSize = pointSize;
+}
 
-	drawBone(jf, tdv::nuitrack::JOINT_HEAD, tdv::nuitrack::JOINT_NECK);
-	drawBone(jf, tdv::nuitrack::JOINT_NECK, tdv::nuitrack::JOINT_LEFT_COLLAR);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_RIGHT_SHOULDER);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_LEFT_SHOULDER);
-	drawBone(jf, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_LEFT_HIP);
-	drawBone(jf, tdv::nuitrack::JOINT_WAIST, tdv::nuitrack::JOINT_RIGHT_HIP);
-	drawBone(jf, tdv::nuitrack::JOINT_TORSO, tdv::nuitrack::JOINT_WAIST);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_COLLAR, tdv::nuitrack::JOINT_TORSO);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_SHOULDER, tdv::nuitrack::JOINT_LEFT_ELBOW);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_ELBOW, tdv::nuitrack::JOINT_LEFT_WRIST);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_WRIST, tdv::nuitrack::JOINT_LEFT_HAND);
-	drawBone(jf, tdv::nuitrack::JOINT_RIGHT_SHOULDER, tdv::nuitrack::JOINT_RIGHT_ELBOW);
-	drawBone(jf, tdv::nuitrack::JOINT_RIGHT_ELBOW, tdv::nuitrack::JOINT_RIGHT_WRIST);
-	drawBone(jf, tdv::nuitrack::JOINT_RIGHT_WRIST, tdv::nuitrack::JOINT_RIGHT_HAND);
-	drawBone(jf, tdv::nuitrack::JOINT_RIGHT_HIP, tdv::nuitrack::JOINT_RIGHT_KNEE);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_HIP, tdv::nuitrack::JOINT_LEFT_KNEE);
-	drawBone(jf, tdv::nuitrack::JOINT_RIGHT_KNEE, tdv::nuitrack::JOINT_RIGHT_ANKLE);
-	drawBone(jf, tdv::nuitrack::JOINT_LEFT_KNEE, tdv::nuitrack::JOINT_LEFT_ANKLE);
+void NuitrackGL::setSkeletonView(bool show, float yaw, float pitch, float distance)
+{
+	_showSkeletonView = show;
+	_skeletonViewYaw = yaw;
+	_skeletonViewPitch = pitch;
+	_skeletonViewDistance = distance;
 }
 
-void NuitrackGL::drawBone(const JointFrame& j1, int index1, int index2)
+void NuitrackGL::setMotionTrails(bool show, int poseCount, int ghostCount)
 {
-	if (j1.confidence[index1] > 0.15 && j1.confidence[index2] > 0.15)
-	{
-		_lines2[numLines2] = (-j1.joints[index1].x * 2) + 1;
-		_lines2[numLines2 + 1] = (-j1.joints[index1].y * 2) + 1;
-		_lines2[numLines2 + 2] = (-j1.joints[index2].x * 2) + 1;
-		_lines2[numLines2 + 3] = (-j1.joints[index2].y * 2) + 1;
+	if (!show && _showMotionTrails)
+		_motionTrails.clear();
 
-		numLines2 += 4;
-	}
+	_showMotionTrails = show;
+	_trailPoseCount = poseCount;
+	_ghostCount = ghostCount;
+	_motionTrails.setPoseCount(poseCount);
 }
 
-// Helper function to draw a skeleton bone
-bool NuitrackGL::drawBone(const tdv::nuitrack::Joint& j1, const tdv::nuitrack::Joint& j2)
+const JointFrame* NuitrackGL::getReplayFrame() const
 {
-	// Prepare line data for confident enough bones only
+	if (!replay.load() || replayPointer >= (int)readJointDataBuffer.size())
+		return NULL;
 
-	// Illustration of the projected coordinates w.r.t the window
-	//////////////////
-	//(1,0)	  (0, 0)//
-	//				//
-	//				//
-	//(1, 1)  (0, 1)//
-	//////////////////
-
-	// This implies that if a joint is at the top left of the window, 
-	// the projected coordinates for the joint will be ~ (1,0)
-	// OpenGl coordinate system in use is -1 to 1 for both x and y.
-	// That means that the top-left joint would be (-1, 1) in OpenGl.
-	// => X-axis 1 to 0 needs to be translated to -1 to 1
-	// => Y-axis 1 to 0 needs to be translated to -1 to 1
+	return &readJointDataBuffer[replayPointer];
+}
 
-	if (j1.confidence > 0.15 && j2.confidence > 0.15)
-	{
-		_lines[numLines] = (-j1.proj.x * 2) + 1;
-		_lines[numLines+1] = (-j1.proj.y * 2) + 1;
-		_lines[numLines+2] = (-j2.proj.x * 2) + 1;
-		_lines[numLines+3] = (-j2.proj.y * 2) + 1;
+void NuitrackGL::updateTrainerSkeleton()
+{
+	const JointFrame& jf = readJointDataBuffer.at(replayPointer);
 
-		numLines += 4;
-		return true;
-	}
-	else 
+	for (int i = 0; i < SKELETON_JOINT_COUNT; i++)
 	{
-		return false;
+		trainerJoints[i].x = jf.joints[i].x;
+		trainerJoints[i].y = jf.joints[i].y;
+		trainerJoints[i].confidence = jf.confidence[i];
+		trainerJoints[i].unused = 0.0f;
+
+		trainerRealJoints[i].x = jf.realJoints[i].x;
+		trainerRealJoints[i].y = jf.realJoints[i].y;
+		trainerRealJoints[i].z = jf.realJoints[i].z;
+		trainerRealJoints[i].confidence = jf.confidence[i];
 	}
 }
 
-// Render prepared background texture
-void NuitrackGL::renderTexture()
+// Everybody in the class is scored against the trainer frame
+void NuitrackGL::scoreUsers()
 {
-	GLCall(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
-	GLCall(glClear(GL_COLOR_BUFFER_BIT));
-	
-	GLCall(glBindTexture(GL_TEXTURE_2D, _textureID));
-	// Todo: Look into using multiple texture buffers for performance
-	GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, GL_RGB, GL_UNSIGNED_BYTE, _textureBuffer));
+	const JointFrame& trainerFrame = readJointDataBuffer[replayPointer];
 
-	GLCall(glBindVertexArray(VAO));
-	GLCall(glUseProgram(shaderProgram));
-	GLCall(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
-	
-	GLCall(glBindVertexArray(0));
+	for (auto& entry : _users)
+	{
+		TrackedUser& user = entry.second;
+		if (!user.hasAllJoints)
+			continue;
+
+		user.alignmentCost = getAlignmentCost(user.angles, trainerFrame);
+		// Mean angle error of 0 degrees scores 100, 90 degrees or more scores 0
+		int meanError = scoringAngleCount > 0 ? user.alignmentCost / scoringAngleCount : 0;
+		user.score = 100 - (std::min)(meanError, 90) * 100 / 90;
+	}
 }
 
-void NuitrackGL::renderLinesUser(const float* skeletonColor, const float* jointColor, const float& pointSize, const float& lineWidth, const float* lines, const int& size, bool render, const bool& overrideJointColour)
+// Only the patient drives the replay
+void NuitrackGL::advanceReplay()
 {
-	if (size == 0 || !render)
+	const TrackedUser* patient = getPatientUser();
+	if (!patient || !patient->hasAllJoints)
 		return;
 
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, VBO2));
-	// Todo: Look into using multiple buffers for performance
-	GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, size * sizeof(float), lines));
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-	GLCall(glBindVertexArray(VAO2));
-
+	int correctness = patient->alignmentCost;
 
-	if (skeletonColorUniformLocation == -1)
+	if (session.load())
 	{
-		GLCall(skeletonColorUniformLocation = glGetUniformLocation(shaderProgram2, "color"));
+		SessionFrame frame;
+		frame.patient = lastUserFrame;
+		frame.trainerFrame = (uint32_t)replayPointer;
+		frame.alignmentCost = (uint16_t)correctness;
+		frame.score = (uint8_t)patient->score;
+		sessionBuffer.push_back(frame);
 	}
 
-	if (pointSizeUniformLocation == -1)
+	if (replayPointer % 30 == 0)
 	{
-		GLCall(pointSizeUniformLocation = glGetUniformLocation(shaderProgram2, "pointSize"));
+		std::cout << "Correctness result: " << correctness << std::endl;
+
+		// The threshold is for all 19 angles, it shrinks with the angles that are compared
+		if (scoringAngleCount == 0 || correctness * ENGINE_ANGLE_COUNT < CORRECTNESS_THRESHOLD * scoringAngleCount)
+		{
+			replayPointer++;
+		}
+	}
+	else {
+		replayPointer++;
 	}
-	GLCall(glUseProgram(shaderProgram2));
+}
 
+// Predict the joints of every user to the time of the image they are drawn over, the renderer
+// uploads them as they are. Unfiltered, the joints of the matched skeleton frame are drawn instead.
+void NuitrackGL::updateUserSkeleton()
+{
+	// Users that are not in the matched skeleton frame yet are drawn with their newest joints
+	for (auto& entry : _users)
+		entry.second.drawnJoints = entry.second.joints;
 
-	if (overrideJointColour)
+	if (!filterSkeleton)
 	{
-		GLCall(glUniform4f(skeletonColorUniformLocation, skeletonColor[0], skeletonColor[1], skeletonColor[2], skeletonColor[3]));
+		// Without a match the newest frames are shown, which the joints already belong to
+		if (!_frameBundleMatched)
+			return;
+
+		for (const tdv::nuitrack::Skeleton& skeleton : _frameBundle.skeletons->getSkeletons())
+		{
+			auto user = _users.find(skeleton.id);
+			if (user != _users.end())
+				user->second.drawnJoints = skeleton.joints;
+		}
+		return;
 	}
-	else
+
+	// The matched image was captured with a skeleton at least as old as the newest,
+	// predicting past it would put the overlay ahead of the image
+	if (_frameBundleMatched)
+	{
+		double frameTime = _frameBundle.timestamp / 1000000.0;
+
+		for (auto& entry : _users)
+			entry.second.filter.predict(frameTime, entry.second.drawnJoints, false);
+		return;
+	}
+
+	// The newest frames are shown, the skeleton is predicted to the current time
+	std::chrono::duration<double> time = std::chrono::steady_clock::now().time_since_epoch();
+	double sensorTime = time.count() - _sensorClockOffset;
+
+	for (auto& entry : _users)
+		entry.second.filter.predict(sensorTime, entry.second.drawnJoints);
+}
+
+// Show the frames captured with the newest skeleton, so the overlay lines up with the image.
+// Until the streams can be matched the newest frames are shown.
+void NuitrackGL::updateFrameBundle()
+{
+	_frameBundleMatched = _frameSynchronizer.getBundle(_frameBundle);
+	if (!_frameBundleMatched)
+		_frameSynchronizer.getLatest(_frameBundle);
+}
+
+// Render prepared background texture
+void NuitrackGL::renderTexture()
+{
+	GLCall(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
+	GLCall(glClear(GL_COLOR_BUFFER_BIT));
+
+	if (_viewMode == DEPTH_SEGMENT_MODE || _viewMode == POINT_CLOUD_MODE)
 	{
-		if (hasAllJoints)
+		const tdv::nuitrack::DepthFrame::Ptr& depthFrame = _frameBundle.depth;
+
+		if (depthFrame && depthFrame->getID() != _uploadedDepthFrameID)
 		{
-			GLCall(glUniform4f(skeletonColorUniformLocation, 0.0f, 1.0f, 0.0f, 1.0f));
+			_depthStreamer.upload(_depthTextureID, depthFrame->getCols(), depthFrame->getRows(), depthFrame->getData());
+			_uploadedDepthFrameID = depthFrame->getID();
 		}
-		else
+
+		if (_viewMode == POINT_CLOUD_MODE)
 		{
-			GLCall(glUniform4f(skeletonColorUniformLocation, 1.0f, 0.0f, 0.0f, 1.0f));
+			GLCall(glClear(GL_DEPTH_BUFFER_BIT));
+
+			GLint viewport[4];
+			GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+			float aspect = viewport[3] > 0 ? (float)viewport[2] / viewport[3] : 1.0f;
+
+			// Orbit around a point in front of the sensor at the orbit distance
+			Matrix4 view = CameraMath::orbit(0.0f, 0.0f, _cloudDistance, _cloudYaw, _cloudPitch, _cloudDistance);
+			Matrix4 projection = CameraMath::perspective(1.0f, aspect, 100.0f, 20000.0f);
+
+			_pointCloudRenderer.render(_depthTextureID, _depthStreamer.getWidth(), _depthStreamer.getHeight(), _depthOutputMode,
+				CameraMath::multiply(projection, view), _cloudPointSize, _depthMin, _depthMax);
+			return;
 		}
+
+		if (depthRangeUniformLocation == -1)
+		{
+			GLCall(depthRangeUniformLocation = glGetUniformLocation(depthShaderProgram, "depthRange"));
+		}
+
+		GLCall(glBindTexture(GL_TEXTURE_2D, _depthTextureID));
+		GLCall(glUseProgram(depthShaderProgram));
+		GLCall(glUniform2f(depthRangeUniformLocation, _depthMin, _depthMax));
+		GLCall(glBindVertexArray(VAO));
+		GLCall(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
+
+		GLCall(glBindVertexArray(0));
+		return;
 	}
 
-	GLCall(glEnable(GL_LINE_SMOOTH));
-	GLCall(glLineWidth(lineWidth));
-	GLCall(glDrawArrays(GL_LINES, 0, size / 2));
-	GLCall(glLineWidth(1.0f));
-	GLCall(glDisable(GL_LINE_SMOOTH));
+	GLCall(glBindTexture(GL_TEXTURE_2D, _textureID));
 
-	if (overrideJointColour)
+	// Upload only when the bundle moved on to a frame we have not shown yet
+	const ColorImage* colorImage = _frameBundle.color.get();
+
+	if (colorImage && colorImage->frame && colorImage->frame->getID() != _uploadedColorFrameID)
 	{
-		GLCall(glUniform4f(skeletonColorUniformLocation, jointColor[0], jointColor[1], jointColor[2], jointColor[3]));
+		const tdv::nuitrack::RGBFrame::Ptr& colorFrame = colorImage->frame;
+
+		// The sensor resolution can differ from the output mode, the streamer follows the frames
+		_colorStreamer.upload(_textureID, colorFrame->getCols(), colorFrame->getRows(), colorImage->getData());
+		_uploadedColorFrameID = colorFrame->getID();
 	}
-	else
+
+	if (_segmentationMode != SEGMENTATION_OFF)
 	{
-		if (hasAllJoints)
-		{
-			GLCall(glUniform4f(skeletonColorUniformLocation, 0.0f, 1.0f, 0.0f, 1.0f));
-		}
-		else
+		const tdv::nuitrack::UserFrame::Ptr& userFrame = _frameBundle.user;
+
+		if (userFrame && userFrame->getID() != _uploadedUserFrameID)
 		{
-			GLCall(glUniform4f(skeletonColorUniformLocation, 1.0f, 0.0f, 0.0f, 1.0f));
+			_labelStreamer.upload(_labelTextureID, userFrame->getCols(), userFrame->getRows(), userFrame->getData());
+			_uploadedUserFrameID = userFrame->getID();
 		}
+
+		GLCall(glActiveTexture(GL_TEXTURE1));
+		GLCall(glBindTexture(GL_TEXTURE_2D, _labelTextureID));
+		GLCall(glActiveTexture(GL_TEXTURE0));
+	}
+
+	if (segmentationModeUniformLocation == -1)
+	{
+		GLCall(segmentationModeUniformLocation = glGetUniformLocation(shaderProgram, "segmentationMode"));
 	}
 
-	GLCall(glEnable(GL_PROGRAM_POINT_SIZE));
-	GLCall(glUniform1f(pointSizeUniformLocation, pointSize));
-	GLCall(glDrawArrays(GL_POINTS, 0, size / 2));
-	GLCall(glDisable(GL_PROGRAM_POINT_SIZE));
+	GLCall(glBindVertexArray(VAO));
+	GLCall(glUseProgram(shaderProgram));
+	// Nothing to composite until the first label map arrived
+	GLCall(glUniform1i(segmentationModeUniformLocation, _uploadedUserFrameID != 0 ? _segmentationMode : SEGMENTATION_OFF));
+	GLCall(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0));
+	
 	GLCall(glBindVertexArray(0));
 }
 
-// Visualize bones, joints and hand positions
-void NuitrackGL::renderLinesTrainer(const float *skeletonColor, const float* jointColor, const float& pointSize, const float& lineWidth, const float* lines, const int& size, bool render, const bool& overrideJointColour)
+// Visualize bones and joints of the user and the trainer in one go
+void NuitrackGL::renderSkeletons(const float* skeletonColor, const float* jointColor, const float& pointSize, const float& lineWidth, bool renderTrainer, const bool& overrideJointColour)
 {
-	if (size == 0 || !render)
-		return;
+	static const float green[4] = { 0.0f, 1.0f, 0.0f, 1.0f };
+	static const float red[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
+	static const float orange[4] = { 1.0f, 0.41f, 0.0f, 1.0f };
 
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, VBO2));
-	// Todo: Look into using multiple buffers for performance
-	GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, size * sizeof(float), lines));
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
-	
-	GLCall(glBindVertexArray(VAO2));
-	
-	
-	if (skeletonColorUniformLocation == -1) 
+	_skeletonRenderer.begin();
+
+	for (const auto& entry : _users)
 	{
-		GLCall(skeletonColorUniformLocation = glGetUniformLocation(shaderProgram2, "color"));
+		const TrackedUser& user = entry.second;
+
+		if (overrideJointColour)
+		{
+			_skeletonRenderer.add(user.drawnJoints, skeletonColor, jointColor);
+			continue;
+		}
+
+		// Bones in the colour the label overlay gives the user,
+		// joints green when every joint is tracked and red otherwise
+		float boneColor[4];
+		getUserColor(user.id, boneColor);
+		_skeletonRenderer.add(user.drawnJoints, boneColor, user.hasAllJoints ? green : red);
 	}
 
-	if (pointSizeUniformLocation == -1)
+	if (renderTrainer)
 	{
-		GLCall(pointSizeUniformLocation = glGetUniformLocation(shaderProgram2, "pointSize"));
+		if (overrideJointColour)
+			_skeletonRenderer.add(trainerJoints, skeletonColor, jointColor);
+		else
+			_skeletonRenderer.add(trainerJoints, orange, orange);
 	}
-	GLCall(glUseProgram(shaderProgram2));
 
-	
-	if (overrideJointColour)
+	// Beneath the skeletons
+	if (_showMotionTrails)
+		_motionTrails.render(lineWidth, _ghostCount);
+
+	_skeletonRenderer.render(lineWidth, pointSize);
+}
+
+// Appends the newest pose of every user and the trainer to their trails
+void NuitrackGL::updateMotionTrails(const float* skeletonColor, bool isReplay, const bool& overrideJointColour)
+{
+	static const float orange[4] = { 1.0f, 0.41f, 0.0f, 1.0f };
+
+	if (!_showMotionTrails)
+		return;
+
+	for (const auto& entry : _users)
 	{
-		GLCall(glUniform4f(skeletonColorUniformLocation, skeletonColor[0], skeletonColor[1], skeletonColor[2], skeletonColor[3]));
+		float color[4] = { skeletonColor[0], skeletonColor[1], skeletonColor[2], 1.0f };
+		if (!overrideJointColour)
+			getUserColor(entry.second.id, color);
+		_motionTrails.push(entry.second.id, entry.second.drawnJoints, color);
 	}
+
+	if (isReplay)
+		_motionTrails.push(TRAINER_TRAIL_ID, trainerJoints, overrideJointColour ? skeletonColor : orange);
 	else
+		_motionTrails.remove(TRAINER_TRAIL_ID);
+}
+
+// Patient and trainer from their real world coordinates, in the bottom right third of the window
+void NuitrackGL::renderSkeletonView(bool renderTrainer)
+{
+	static const float orange[4] = { 1.0f, 0.41f, 0.0f, 1.0f };
+	static const float white[4] = { 0.9f, 0.9f, 0.9f, 1.0f };
+
+	GLint viewport[4];
+	GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+	int width = viewport[2] / 3;
+	int height = viewport[3] / 3;
+
+	_skeletonViewport.begin();
+
+	// Orbit around the waist of the patient, or in front of the sensor while nobody is tracked
+	float target[3] = { 0.0f, 0.0f, 2500.0f };
+	const TrackedUser* patient = getPatientUser();
+	bool hasWaist = patient && patient->drawnJoints[tdv::nuitrack::JOINT_WAIST].confidence > 0.15f;
+	if (hasWaist)
 	{
-		GLCall(glUniform4f(skeletonColorUniformLocation, 1.0f, 0.41f, 0.0f, 1.0f));
+		const tdv::nuitrack::Vector3& waist = patient->drawnJoints[tdv::nuitrack::JOINT_WAIST].real;
+		target[0] = waist.x;
+		target[1] = waist.y;
+		target[2] = waist.z;
 	}
-	
-	GLCall(glEnable(GL_LINE_SMOOTH));
-	GLCall(glLineWidth(lineWidth));
-	GLCall(glDrawArrays(GL_LINES, 0, size / 2));
-	GLCall(glLineWidth(1.0f));
-	GLCall(glDisable(GL_LINE_SMOOTH));
 
-	if (overrideJointColour)
+	for (const auto& entry : _users)
 	{
-		GLCall(glUniform4f(skeletonColorUniformLocation, jointColor[0], jointColor[1], jointColor[2], jointColor[3]));
+		float boneColor[4];
+		getUserColor(entry.second.id, boneColor);
+		_skeletonViewport.add(entry.second.drawnJoints, boneColor, white);
 	}
-	else
+
+	// Recordings from before real world coordinates were stored have none, z is never 0 otherwise
+	if (renderTrainer && trainerRealJoints[tdv::nuitrack::JOINT_WAIST].z > 0.0f)
 	{
-		GLCall(glUniform4f(skeletonColorUniformLocation, 1.0f, 0.41f, 0.0f, 1.0f));
+		// The trainer was recorded elsewhere in the room, move its waist onto the patient's
+		const RealJoint& trainerWaist = trainerRealJoints[tdv::nuitrack::JOINT_WAIST];
+		float offset[3] = { 0.0f, 0.0f, 0.0f };
+		if (hasWaist && trainerWaist.confidence > 0.15f)
+		{
+			offset[0] = target[0] - trainerWaist.x;
+			offset[1] = target[1] - trainerWaist.y;
+			offset[2] = target[2] - trainerWaist.z;
+		}
+
+		RealJoint joints[VIEWPORT_JOINT_COUNT];
+		for (int i = 0; i < VIEWPORT_JOINT_COUNT; i++)
+		{
+			joints[i] = trainerRealJoints[i];
+			joints[i].x += offset[0];
+			joints[i].y += offset[1];
+			joints[i].z += offset[2];
+		}
+		_skeletonViewport.add(joints, orange, orange);
 	}
 
-	GLCall(glEnable(GL_PROGRAM_POINT_SIZE));
-	GLCall(glUniform1f(pointSizeUniformLocation, pointSize));
-	GLCall(glDrawArrays(GL_POINTS, 0, size / 2));
-	GLCall(glDisable(GL_PROGRAM_POINT_SIZE));
-	GLCall(glBindVertexArray(0));
+	_skeletonViewport.setCamera(target[0], target[1], target[2], _skeletonViewYaw, _skeletonViewPitch, _skeletonViewDistance);
+	_skeletonViewport.render(viewport[0] + viewport[2] - width, viewport[1], width, height);
 }
 
-void NuitrackGL::initLines()
-{
-	GLCall(int vertexShader = glCreateShader(GL_VERTEX_SHADER));
-	GLCall(glShaderSource(vertexShader, 1, &vertexShaderSource2, NULL));
-	GLCall(glCompileShader(vertexShader));
-	// check for shader compile errors
-	int success;
-	char infoLog[512];
-	GLCall(glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success));
-	if (!success)
-	{
-		GLCall(glGetShaderInfoLog(vertexShader, 512, NULL, infoLog));
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	}
-	// fragment shader
-	GLCall(int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
-	GLCall(glShaderSource(fragmentShader, 1, &fragmentShaderSource2, NULL));
-	GLCall(glCompileShader(fragmentShader));
-	// check for shader compile errors
-	GLCall(glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success));
-	if (!success)
-	{
-		glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-	}
-	// link shaders
-	shaderProgram2 = glCreateProgram();
-	GLCall(glAttachShader(shaderProgram2, vertexShader));
-	GLCall(glAttachShader(shaderProgram2, fragmentShader));
-	GLCall(glLinkProgram(shaderProgram2));
-	// check for linking errors
-	GLCall(glGetProgramiv(shaderProgram2, GL_LINK_STATUS, &success));
-	if (!success) {
-		glGetProgramInfoLog(shaderProgram2, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-	}
-	GLCall(glDeleteShader(vertexShader));
-	GLCall(glDeleteShader(fragmentShader));
-
-	GLCall(glGenVertexArrays(1, &VAO2));
-	GLCall(glGenBuffers(1, &VBO2));
-	
-	GLCall(glBindVertexArray(VAO2));
-	
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, VBO2));
-	GLCall(glBufferData(GL_ARRAY_BUFFER, 72 * sizeof(float), 0, GL_DYNAMIC_DRAW));
+// Uses the quad from initTexture, only the texture and the fragment shader differ
+void NuitrackGL::initDepthTexture()
+{
+	depthShaderProgram = ShaderManager::getProgram(depthProgramSource);
 
-	GLCall(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)0));
-	GLCall(glEnableVertexAttribArray(0));
-	
-	// These lines can be removed for the final versoin but are helpful while developing
-	GLCall(glBindVertexArray(0));
-	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
-	GLCall(glDisableVertexAttribArray(0));
+	GLCall(glGenTextures(1, &_depthTextureID));
+	GLCall(glBindTexture(GL_TEXTURE_2D, _depthTextureID));
+
+	// Interpolating would mix missing depth (0) into the edges of objects
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+	// Depth is uploaded in mm as is, the texture is allocated with the first frame
+	_depthStreamer.init(GL_R16, GL_RED, GL_UNSIGNED_SHORT, 2);
 }
 
-void NuitrackGL::initTexture(int width, int height)
+void NuitrackGL::initTexture()
 {
-	GLCall(int vertexShader = glCreateShader(GL_VERTEX_SHADER));
-	GLCall(glShaderSource(vertexShader, 1, &vertexShaderSource, NULL));
-	GLCall(glCompileShader(vertexShader));
-	// check for shader compile errors
-	int success;
-	char infoLog[512];
-	GLCall(glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success));
-	if (!success)
-	{
-		GLCall(glGetShaderInfoLog(vertexShader, 512, NULL, infoLog));
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-	}
-	// fragment shader
-	GLCall(int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
-	GLCall(glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL));
-	GLCall(glCompileShader(fragmentShader));
-	// check for shader compile errors
-	GLCall(glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success));
-	if (!success)
-	{
-		GLCall(glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog));
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-	}
-	// link shaders
-	GLCall(shaderProgram = glCreateProgram());
-	GLCall(glAttachShader(shaderProgram, vertexShader));
-	GLCall(glAttachShader(shaderProgram, fragmentShader));
-	GLCall(glLinkProgram(shaderProgram));
-	// check for linking errors
-	GLCall(glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success));
-	if (!success) {
-		GLCall(glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog));
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-	}
-	GLCall(glDeleteShader(vertexShader));
-	GLCall(glDeleteShader(fragmentShader));
-
+	shaderProgram = ShaderManager::getProgram(imageProgramSource);
 
-	// Set texture coordinates [0, 1] and vertexes position
+	// Set texture coordinates [0, 1] and vertexes position.
+	// Frames are uploaded top row first, so t runs downwards, and s runs right to left to mirror the camera image.
 	float vertices[] = {
 		// positions         // texture coords
-		1.0f,  1.0f, 0.0f,   1.0f, 1.0f,   // top right
-		1.0f, -1.0f, 0.0f,   1.0f, 0.0f,   // bottom right
-		-1.0f, -1.0f, 0.0f,  0.0f, 0.0f,   // bottom left
-		-1.0f,  1.0f, 0.0f,  0.0f, 1.0f    // top left 
+		1.0f,  1.0f, 0.0f,   0.0f, 0.0f,   // top right
+		1.0f, -1.0f, 0.0f,   0.0f, 1.0f,   // bottom right
+		-1.0f, -1.0f, 0.0f,  1.0f, 1.0f,   // bottom left
+		-1.0f,  1.0f, 0.0f,  1.0f, 0.0f    // top left 
 	};
 
 	unsigned int indices[] = {
@@ -916,20 +1337,31 @@ void NuitrackGL::initTexture(int width, int height)
 	GLCall(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float))));
 	GLCall(glEnableVertexAttribArray(1));
 	
-	if (_textureBuffer != 0)
-		delete[] _textureBuffer;
-	
-	_textureBuffer = new uint8_t[width * height * 3];
-	memset(_textureBuffer, 0, sizeof(uint8_t) * width * height * 3);
-	
 	GLCall(glGenTextures(1, &_textureID));
 	GLCall(glBindTexture(GL_TEXTURE_2D, _textureID));
 	
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
 	
-	// This line effectively does not allow resolution of texture to be changed.
-	GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL));	
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+	// Color3 is stored blue, green, red. The texture is allocated with the first frame.
+	_colorStreamer.init(GL_RGB8, GL_BGR, GL_UNSIGNED_BYTE, 3);
+
+	// User IDs are integers and must not be filtered
+	GLCall(glGenTextures(1, &_labelTextureID));
+	GLCall(glBindTexture(GL_TEXTURE_2D, _labelTextureID));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	_labelStreamer.init(GL_R16UI, GL_RED_INTEGER, GL_UNSIGNED_SHORT, 2);
+
+	GLCall(glUseProgram(shaderProgram));
+	GLCall(glUniform1i(glGetUniformLocation(shaderProgram, "ourTexture"), 0));
+	GLCall(glUniform1i(glGetUniformLocation(shaderProgram, "labelTexture"), 1));
+	GLCall(glUseProgram(0));
 	
 	// These lines can be removed for the final versoin but are helpful while developing
 	GLCall(glBindVertexArray(0));
@@ -2,18 +2,46 @@
 #define NUITRACKGLSAMPLE_H_
 
 #include "opgl.h"
+#include "AngleStatistics.h"
+#include "SymmetryAnalyzer.h"
+#include "BalanceEstimator.h"
+#include "SmoothnessAnalyzer.h"
+#include "KeyframeExtractor.h"
+#include "SkeletonFilter.h"
+#include "AngleEngine.h"
+#include "AnatomicalAngles.h"
+#include "FrameSynchronizer.h"
+#include "TextureStreamer.h"
+#include "PointCloudRenderer.h"
+#include "PrivacyFilter.h"
+#include "SkeletonRenderer.h"
+#include "SkeletonViewport.h"
+#include "MotionTrails.h"
+#include "TaskGraph.h"
 #include <nuitrack/Nuitrack.h>
 #include <string>
+#include <map>
 #include <ctime>
 #include <chrono>
+#include <thread>
 
 typedef enum
 {
 	DEPTH_SEGMENT_MODE = 0,
 	RGB_MODE = 1,
+	POINT_CLOUD_MODE = 2,
 	MODES_MAX_COUNT
 } ViewMode;
 
+// How the users from the UserTracker label map are shown on the color image
+typedef enum
+{
+	SEGMENTATION_OFF = 0,
+	SEGMENTATION_TINT = 1,
+	SEGMENTATION_OUTLINE = 2,
+	SEGMENTATION_DIM_BACKGROUND = 3
+} SegmentationMode;
+
 struct Vector2
 {
 	float x;
@@ -39,10 +67,45 @@ struct Vector3
 struct JointFrame 
 {
 	std::time_t timeStamp;
+	uint64_t sensorTimestamp; // Nuitrack timestamp of the skeleton in microseconds, pairs the frame with the video
 	Vector2 joints[25];
 	Vector3 realJoints[25];
 	float confidence[25];
 	int angles[19];
+	float anatomicalAngles[ANATOMICAL_JOINT_COUNT][ANATOMICAL_AXIS_COUNT];
+};
+
+#define BONE_COUNT 18
+
+// Pairs of joints connected by a bone
+extern const int skeletonBones[BONE_COUNT][2];
+
+// A patient frame recorded while a trainer recording is replayed.
+// The trainer frame index, alignment cost and score shown at that moment are stored
+// alongside the patient joints so a session can be reviewed without re-running alignment.
+// Adds 8 bytes per frame on top of the JointFrame.
+struct SessionFrame
+{
+	JointFrame patient;
+	uint32_t trainerFrame;
+	uint16_t alignmentCost; // Manhattan distance between patient and trainer angles
+	uint8_t score; // 0-100, 100 being a perfect match
+};
+
+// Everything tracked for one person in front of the sensor, keyed by the Nuitrack skeleton ID
+struct TrackedUser
+{
+	int id = 0;
+	double firstSeen = 0.0; // Sensor time in seconds
+	// Latest joints, as recorded and analyzed
+	std::vector<tdv::nuitrack::Joint> joints;
+	// Joints drawn over the image shown, the filtered prediction or the skeleton frame matched with the image
+	std::vector<tdv::nuitrack::Joint> drawnJoints;
+	SkeletonFilter filter;
+	bool hasAllJoints = false;
+	int angles[19] = {};
+	int alignmentCost = -1; // Against the replayed trainer frame, -1 when not scored
+	int score = -1;
 };
 
 // Main class of the sample
@@ -56,8 +119,13 @@ public:
 	// register callbacks and start Nuitrack
 	void init(const std::string& config = "");
 	
-	// Update the depth map, tracking and gesture recognition data,
-	// then redraw the view
+	// Receive the frames Nuitrack captured since the last call while the stages of the last frame
+	// finish, then wait for them. Until update() nothing runs in the background, so everything
+	// can be read and changed from the interface.
+	bool ingest();
+
+	// Run the stages on the received frames, then redraw the view. The analytics, scoring
+	// and replay keep running after it returns, up to the next ingest().
 	bool update(float* skeletonColor, float* jointColor, const float& pointSize, const float& lineWidth, const bool& overrideJointColour);
 	
 	// Release all sample resources
@@ -73,38 +141,180 @@ public:
 	void loadDataToBuffer(const std::string& path);
 	void saveBufferToDisk();
 	void playLoadedData();
+	// Replay the loaded trainer data and record the patient against it
+	void startSession();
+	// Frames of the running or the last session
+	const std::vector<SessionFrame>& getSessionFrames() const { return sessionBuffer; }
+
+	// Range of motion statistics of the running or the last recording or session
+	AngleStatistics& getAngleStatistics() { return angleStatistics; }
+	// Statistics merged across all sessions added to the history
+	AngleStatistics& getHistoryStatistics() { return historyStatistics; }
+	void addStatisticsToHistory();
+
+	const SymmetryAnalyzer& getSymmetryAnalyzer() const { return symmetryAnalyzer; }
+	BalanceEstimator& getBalanceEstimator() { return balanceEstimator; }
+	const SmoothnessAnalyzer& getSmoothnessAnalyzer() const { return smoothnessAnalyzer; }
+	// Smoothness of the loaded trainer data, averaged over the whole recording
+	void analyzeLoadedData();
+	const SmoothnessReport* getLoadedDataSmoothness() const { return loadedDataSmoothness; }
+
+	// Cluster the loaded trainer data into key poses and save them next to the data
+	void extractKeyframes(int count);
+	// Jump the replay to a keyframe
+	void previewKeyframe(int index);
+	const std::vector<Keyframe>& getKeyframes() const { return keyframes; }
+	const std::vector<JointFrame>& getLoadedData() const { return readJointDataBuffer; }
+	// Keyframe closest to the patient's current pose, -1 if unknown
+	int getClosestKeyframe() const { return closestKeyframe; }
+
+	// Applied to the filter of every user, see SkeletonFilter::setParameters
+	void setSkeletonFilterParameters(float minCutoff, float beta, float latency);
+	void setSkeletonFiltering(bool enabled) { filterSkeleton = enabled; }
+
+	const std::map<int, TrackedUser>& getUsers() const { return _users; }
+	// The patient is recorded, analyzed and drives the replay. 0 picks the user tracked the longest.
+	void setPatient(int id) { _patientID = id; }
+	int getPatientSetting() const { return _patientID; }
+
+	// Angles the exercise is scored on, bit i selects angle i. All angles are still computed,
+	// recorded and analyzed, so recordings made under different masks can be compared.
+	void setScoringMask(uint32_t mask);
+	uint32_t getScoringMask() const { return scoringMask; }
+	TextureStreamer& getColorStreamer() { return _colorStreamer; }
+	PrivacyFilter& getPrivacyFilter() { return _privacyFilter; }
+	FrameSynchronizer& getFrameSynchronizer() { return _frameSynchronizer; }
+	// Frames shown by the last render, false if they are just the newest ones because nothing matched
+	const FrameBundle& getFrameBundle() const { return _frameBundle; }
+	bool isFrameBundleMatched() const { return _frameBundleMatched; }
+
+	void setViewMode(ViewMode mode) { _viewMode = mode; }
+	ViewMode getViewMode() const { return _viewMode; }
+	// Depths in mm mapped to the two ends of the colormap
+	void setDepthRange(float minDepth, float maxDepth) { _depthMin = minDepth; _depthMax = maxDepth; }
+	void setSegmentationMode(SegmentationMode mode) { _segmentationMode = mode; }
+	// Orbit around the patient in the point cloud view, angles in radians and distance in mm
+	void setPointCloudCamera(float yaw, float pitch, float distance, float pointSize);
+	// 3D view of the skeletons in a corner of the window, orbiting around the patient
+	void setSkeletonView(bool show, float yaw, float pitch, float distance);
+	float getSkeletonViewGpuMs() const { return _skeletonViewport.getGpuMs(); }
+	// Trails behind the hands, knees and ankles over the last poses, plus ghost skeletons of earlier poses
+	void setMotionTrails(bool show, int poseCount, int ghostCount);
+
+	const JointFrame& getLastUserFrame() const { return lastUserFrame; }
+	// Trainer frame currently shown, NULL when nothing is replayed
+	const JointFrame* getReplayFrame() const;
 
 private:
-	int userAngles[19];
+	AngleStatistics angleStatistics;
+	AngleStatistics historyStatistics;
+	SymmetryAnalyzer symmetryAnalyzer;
+	BalanceEstimator balanceEstimator;
+	SmoothnessAnalyzer smoothnessAnalyzer;
+	SmoothnessAnalyzer batchSmoothnessAnalyzer;
+	SmoothnessReport loadedDataSmoothness[SMOOTHNESS_JOINT_COUNT];
 
 	std::mutex jointDataBufferMutex;
 
 	std::vector<JointFrame> writeJointDataBuffer;
 	std::vector<JointFrame> readJointDataBuffer;
+	std::vector<SessionFrame> sessionBuffer;
+	std::string sessionName;
+	std::thread sessionWriterThread;
+	std::vector<Keyframe> keyframes;
+	std::string loadedDataPath;
+	int closestKeyframe = -1;
+
+	AngleEngine angleEngine;
+	uint32_t scoringMask = ENGINE_ALL_ANGLES;
+	int scoringAngleCount = ENGINE_ANGLE_COUNT;
+	// Every tracked user, users that leave the view are removed
+	std::map<int, TrackedUser> _users;
+	int _patientID = 0;
+	float filterMinCutoff = 1.0f;
+	float filterBeta = 5.0f;
+	float filterLatency = 0.033f;
+	bool filterSkeleton = true;
+	// Skeletons received since the last update, processed by the frame stages
+	tdv::nuitrack::SkeletonData::Ptr _newSkeletons;
+	double _newSkeletonTime = 0.0; // Sensor time in seconds
+	// Users the stages removed, their trails are removed by the render
+	std::vector<int> _removedUsers;
+	// Label map with the newest floor, handed to the balance estimator once the analytics are done
+	tdv::nuitrack::UserFrame::Ptr _newUserFrame;
+	// Render clock minus sensor clock in seconds, maps the current time to the filters
+	double _sensorClockOffset = 0.0;
+	bool _hasSensorClockOffset = false;
+	JointFrame lastUserFrame;
 	int replayPointer = 0;
+	int loadedTrainerFrame = -1; // Replay position of the trainer joints, -1 if none are loaded
 
 	std::atomic<bool> record;
 	std::atomic<bool> saving;
+	std::atomic<bool> saveRequested; // Set by the timer thread when the recording stopped
+	std::thread recordingWriterThread;
 
 	std::atomic<bool> replay;
+	std::atomic<bool> session;
 
 	int _width, _height;
 	// GL data
-	int skeletonColorUniformLocation = -1;
-	int pointSizeUniformLocation = -1;
 	int shaderProgram;
-	int shaderProgram2;
 	unsigned int VBO, VAO, EBO; // For textures
-	unsigned int VBO2, VAO2; // For lines
 	GLuint _textureID;
-	uint8_t* _textureBuffer;
+	// Frames handed from the Nuitrack callbacks to the render loop, which shows the frames
+	// captured together with the newest skeleton it can match
+	FrameSynchronizer _frameSynchronizer;
+	FrameBundle _frameBundle;
+	bool _frameBundleMatched = false;
+	PrivacyFilter _privacyFilter;
+	uint64_t _uploadedColorFrameID = 0;
+	TextureStreamer _colorStreamer;
+
+	// Depth frames are only uploaded while the depth view is shown
+	ViewMode _viewMode = RGB_MODE;
+	uint64_t _uploadedDepthFrameID = 0;
+	TextureStreamer _depthStreamer;
+	GLuint _depthTextureID = 0;
+	int depthShaderProgram;
+	int depthRangeUniformLocation = -1;
+	float _depthMin = 500.0f;
+	float _depthMax = 4500.0f;
+
+	tdv::nuitrack::OutputMode _depthOutputMode;
+	PointCloudRenderer _pointCloudRenderer;
+	float _cloudYaw = 0.0f;
+	float _cloudPitch = 0.0f;
+	float _cloudDistance = 2000.0f;
+	float _cloudPointSize = 2.0f;
+
+	// User label maps are only uploaded while the overlay is shown
+	SegmentationMode _segmentationMode = SEGMENTATION_OFF;
+	uint64_t _uploadedUserFrameID = 0;
+	TextureStreamer _labelStreamer;
+	GLuint _labelTextureID = 0;
+	int segmentationModeUniformLocation = -1;
 	GLfloat _textureCoords[8];
 	GLfloat _vertexes[8];
-	GLfloat _lines[72];
-	GLfloat _lines2[72];
-	int numLines = 0;
-	int numLines2 = 0;
-	bool hasAllJoints = false;
+	SkeletonRenderer _skeletonRenderer;
+	// Trainer joints of the replayed frame, in the layout the renderer uploads
+	SkeletonJoint trainerJoints[SKELETON_JOINT_COUNT];
+	RealJoint trainerRealJoints[VIEWPORT_JOINT_COUNT];
+
+	MotionTrails _motionTrails;
+	bool _showMotionTrails = false;
+	int _trailPoseCount = 30;
+	int _ghostCount = 3;
+
+	SkeletonViewport _skeletonViewport;
+	bool _showSkeletonView = false;
+	float _skeletonViewYaw = 0.5f;
+	float _skeletonViewPitch = 0.3f;
+	float _skeletonViewDistance = 3000.0f;
+
+	// Runs the per frame stages, no more than two of them are ready at the same time
+	WorkerPool _workers;
+	TaskGraph _frameTasks;
 
 	tdv::nuitrack::OutputMode _outputMode;
 	tdv::nuitrack::DepthSensor::Ptr _depthSensor;
@@ -121,33 +331,46 @@ private:
 	 * Nuitrack callbacks
 	 */
 	void onNewRGBFrame(tdv::nuitrack::RGBFrame::Ptr frame);
+	void onNewDepthFrame(tdv::nuitrack::DepthFrame::Ptr frame);
 	void onLostUserCallback(int id);
 	void onNewUserCallback(int id);
+	void onUserUpdate(tdv::nuitrack::UserFrame::Ptr frame);
 	void onSkeletonUpdate(tdv::nuitrack::SkeletonData::Ptr userSkeletons);
 	void onIssuesUpdate(tdv::nuitrack::IssuesData::Ptr issuesData);
 	
+	/**
+	 * Skeleton processing
+	 */
+	void updateUsers(const std::vector<tdv::nuitrack::Skeleton>& skeletons, double time);
+	void updateUser(TrackedUser& user, const std::vector<tdv::nuitrack::Joint>& joints, double time);
+	void updatePatient(const TrackedUser& user, uint64_t timestamp, double time);
+	TrackedUser* getPatientUser();
+	void updateSensorClockOffset(double sensorTime, double renderTime);
+
 	/**
 	 * Draw methods
 	 */
-	void drawSkeleton(const std::vector<tdv::nuitrack::Joint>& joints);
-	void drawBone(const JointFrame& j1, int index1, int index2);
-	bool drawBone(const tdv::nuitrack::Joint& j1, const tdv::nuitrack::Joint& j2);
 	void renderTexture();
-	void renderLinesUser(const float* skeletonColor, const float* jointColor, const float& pointSize, const float& lineWidth, const float* lines, const int& numLines, bool render, const bool& overrideJointColour);
-	void renderLinesTrainer(const float* skeletonColor, const float* jointColor, const float& pointSize, const float& lineWidth, const float* lines, const int& numLines, bool render, const bool& overrideJointColour);
+	void renderSkeletons(const float* skeletonColor, const float* jointColor, const float& pointSize, const float& lineWidth, bool renderTrainer, const bool& overrideJointColour);
+	void renderSkeletonView(bool renderTrainer);
+	void updateMotionTrails(const float* skeletonColor, bool isReplay, const bool& overrideJointColour);
 
 	void updateTrainerSkeleton();
+	void updateUserSkeleton();
+	void updateFrameBundle();
+	void scoreUsers();
+	void advanceReplay();
 	
-	void initTexture(int width, int height);
-	void initLines();
+	void initTexture();
+	void initDepthTexture();
 
 	void stopRecording();
 	void stopRecordingTimer(const int& duration);
+	void writeRecording(std::vector<JointFrame> frames, AngleStatistics statistics);
+	void stopSession();
+	static void writeSession(std::string name, std::vector<SessionFrame> frames, AngleStatistics statistics);
 
-	// Anti-clockwise angle from 0-360
-	int get2DAngleABC(const JointFrame& jointFrame, int a_index, int b_index, int c_index);
-	int get3DAngleABC(const JointFrame& jointFrame, int a_index, int b_index, int c_index);
-	int get3DAngleABC(const std::vector<tdv::nuitrack::Joint>& joints, int a_index, int b_index, int c_index);
+	int getAlignmentCost(const int* angles, const JointFrame& trainerFrame);
 };
 
 #endif /* NUITRACKGLSAMPLE_H_ */
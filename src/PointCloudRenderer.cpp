@@ -0,0 +1,105 @@
+#include "PointCloudRenderer.h"
+#include "ShaderManager.h"
+
+#include <iostream>
+#include <cmath>
+
+// One vertex per depth pixel, the pixel comes from gl_VertexID
+static const char* vertexShaderSource =
+"#version 330 core\n"
+"uniform sampler2D depthTexture;\n"
+"uniform vec4 intrinsics;\n" // fx, fy, cx, cy in texture pixels
+"uniform mat4 viewProjection;\n"
+"uniform float pointSize;\n"
+"out float depth;\n"
+"void main()\n"
+"{\n"
+"   ivec2 size = textureSize(depthTexture, 0);\n"
+"   ivec2 pixel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);\n"
+"   depth = texelFetch(depthTexture, pixel, 0).r * 65535.0;\n"
+"   if (depth == 0.0)\n"
+"   {\n"
+"       // No depth, put the point outside the clip volume\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   vec3 real = vec3((float(pixel.x) - intrinsics.z) * depth / intrinsics.x, (intrinsics.w - float(pixel.y)) * depth / intrinsics.y, depth);\n"
+"   gl_Position = viewProjection * vec4(real, 1.0);\n"
+"   gl_PointSize = pointSize;\n"
+"}\n";
+
+static const char* fragmentShaderSource[3] = {
+"#version 330 core\n",
+turboColormapSource,
+"uniform vec2 depthRange;\n"
+"in float depth;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   FragColor = vec4(turbo((depth - depthRange.x) / (depthRange.y - depthRange.x)), 1.0);\n"
+"}\n" };
+
+static const ShaderProgramSource programSource = { "point_cloud", &vertexShaderSource, 1, fragmentShaderSource, 3 };
+static ShaderRegistration registration(programSource);
+
+PointCloudRenderer::PointCloudRenderer() :
+	shaderProgram(0),
+	VAO(0),
+	intrinsicsUniformLocation(-1),
+	viewProjectionUniformLocation(-1),
+	pointSizeUniformLocation(-1),
+	depthRangeUniformLocation(-1)
+{
+}
+
+void PointCloudRenderer::init()
+{
+	shaderProgram = ShaderManager::getProgram(programSource);
+
+	GLCall(intrinsicsUniformLocation = glGetUniformLocation(shaderProgram, "intrinsics"));
+	GLCall(viewProjectionUniformLocation = glGetUniformLocation(shaderProgram, "viewProjection"));
+	GLCall(pointSizeUniformLocation = glGetUniformLocation(shaderProgram, "pointSize"));
+	GLCall(depthRangeUniformLocation = glGetUniformLocation(shaderProgram, "depthRange"));
+
+	GLCall(glGenVertexArrays(1, &VAO));
+}
+
+void PointCloudRenderer::release()
+{
+	if (shaderProgram)
+	{
+		GLCall(glDeleteVertexArrays(1, &VAO));
+		shaderProgram = 0;
+		VAO = 0;
+	}
+}
+
+void PointCloudRenderer::render(GLuint depthTexture, int width, int height, const tdv::nuitrack::OutputMode& mode,
+	const Matrix4& viewProjection, float pointSize, float minDepth, float maxDepth)
+{
+	if (width == 0 || height == 0 || mode.xres == 0)
+		return;
+
+	// Pinhole model from the horizontal field of view, with square pixels.
+	// Scaled in case the frames do not have the resolution of the output mode.
+	float focal = mode.xres / (2.0f * std::tan(mode.hfov * 0.5f));
+	float fx = focal * width / mode.xres;
+	float fy = focal * height / mode.yres;
+
+	GLCall(glEnable(GL_DEPTH_TEST));
+	GLCall(glEnable(GL_PROGRAM_POINT_SIZE));
+
+	GLCall(glBindTexture(GL_TEXTURE_2D, depthTexture));
+	GLCall(glUseProgram(shaderProgram));
+	GLCall(glUniform4f(intrinsicsUniformLocation, fx, fy, width * 0.5f, height * 0.5f));
+	GLCall(glUniformMatrix4fv(viewProjectionUniformLocation, 1, GL_FALSE, viewProjection.m));
+	GLCall(glUniform1f(pointSizeUniformLocation, pointSize));
+	GLCall(glUniform2f(depthRangeUniformLocation, minDepth, maxDepth));
+
+	GLCall(glBindVertexArray(VAO));
+	GLCall(glDrawArrays(GL_POINTS, 0, width * height));
+	GLCall(glBindVertexArray(0));
+
+	GLCall(glDisable(GL_PROGRAM_POINT_SIZE));
+	GLCall(glDisable(GL_DEPTH_TEST));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "opgl.h"
+#include "CameraMath.h"
+
+#include <nuitrack/Nuitrack.h>
+
+// Draws the depth texture as a point cloud with a single attributeless call.
+// The vertex shader finds its pixel from gl_VertexID, reads the depth and unprojects it with the
+// pinhole intrinsics of the depth OutputMode, so the CPU never touches the depth values.
+class PointCloudRenderer
+{
+public:
+	PointCloudRenderer();
+
+	// Needs a current GL context
+	void init();
+	void release();
+
+	// width and height of the depth texture, depth range in mm for the colormap
+	void render(GLuint depthTexture, int width, int height, const tdv::nuitrack::OutputMode& mode,
+		const Matrix4& viewProjection, float pointSize, float minDepth, float maxDepth);
+
+private:
+	int shaderProgram;
+	GLuint VAO; // Empty, core profile needs one bound to draw
+
+	int intrinsicsUniformLocation;
+	int viewProjectionUniformLocation;
+	int pointSizeUniformLocation;
+	int depthRangeUniformLocation;
+};
@@ -0,0 +1,286 @@
+#include "PrivacyFilter.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PRIVACY_SSE
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles AVX2 intrinsics without any flag, the CPU is checked at runtime
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#define MAX_BLUR_RADIUS 64 // Column sums of 2 * 64 + 1 rows still fit in 16 bits
+
+typedef void (*MaskKernel)(const uint8_t* color, const uint8_t* background, const uint8_t* mask, uint8_t* output, int size);
+
+// output = mask ? color : background, background NULL is black
+static void applyMaskScalar(const uint8_t* color, const uint8_t* background, const uint8_t* mask, uint8_t* output, int size)
+{
+	if (background)
+	{
+		for (int i = 0; i < size; i++)
+			output[i] = (color[i] & mask[i]) | (background[i] & ~mask[i]);
+	}
+	else
+	{
+		for (int i = 0; i < size; i++)
+			output[i] = color[i] & mask[i];
+	}
+}
+
+#ifdef PRIVACY_SSE
+
+static void applyMaskSSE(const uint8_t* color, const uint8_t* background, const uint8_t* mask, uint8_t* output, int size)
+{
+	int i = 0;
+
+	if (background)
+	{
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+			__m128i c = _mm_loadu_si128((const __m128i*)(color + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(background + i));
+			_mm_storeu_si128((__m128i*)(output + i), _mm_or_si128(_mm_and_si128(m, c), _mm_andnot_si128(m, b)));
+		}
+	}
+	else
+	{
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+			__m128i c = _mm_loadu_si128((const __m128i*)(color + i));
+			_mm_storeu_si128((__m128i*)(output + i), _mm_and_si128(m, c));
+		}
+	}
+
+	applyMaskScalar(color + i, background ? background + i : NULL, mask + i, output + i, size - i);
+}
+
+TARGET_AVX2 static void applyMaskAVX2(const uint8_t* color, const uint8_t* background, const uint8_t* mask, uint8_t* output, int size)
+{
+	int i = 0;
+
+	if (background)
+	{
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i m = _mm256_loadu_si256((const __m256i*)(mask + i));
+			__m256i c = _mm256_loadu_si256((const __m256i*)(color + i));
+			__m256i b = _mm256_loadu_si256((const __m256i*)(background + i));
+			_mm256_storeu_si256((__m256i*)(output + i), _mm256_blendv_epi8(b, c, m));
+		}
+	}
+	else
+	{
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i m = _mm256_loadu_si256((const __m256i*)(mask + i));
+			__m256i c = _mm256_loadu_si256((const __m256i*)(color + i));
+			_mm256_storeu_si256((__m256i*)(output + i), _mm256_and_si256(m, c));
+		}
+	}
+
+	applyMaskScalar(color + i, background ? background + i : NULL, mask + i, output + i, size - i);
+}
+
+static bool hasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// The OS must save the AVX registers as well
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static MaskKernel getMaskKernel()
+{
+#ifdef PRIVACY_SSE
+	return hasAVX2() ? applyMaskAVX2 : applyMaskSSE;
+#else
+	return applyMaskScalar;
+#endif
+}
+
+static const MaskKernel applyMask = getMaskKernel();
+
+PrivacyFilter::PrivacyFilter()
+{
+	mode.store(PRIVACY_OFF);
+	blurRadius.store(16);
+	lastTime.store(0.0f);
+}
+
+void PrivacyFilter::apply(const uint8_t* color, int cols, int rows, const uint16_t* labels, int labelCols, int labelRows, int userID, uint8_t* output)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const int rowSize = cols * 3;
+	const uint8_t* background = NULL;
+
+	if (getMode() == PRIVACY_BLUR)
+	{
+		blur(color, cols, rows, (std::min)((std::max)(blurRadius.load(), 1), MAX_BLUR_RADIUS));
+		background = blurred.data();
+	}
+
+	// Label 0 is the background, nobody to show
+	if (userID <= 0)
+		labels = NULL;
+
+	maskRow.resize(rowSize);
+	if (labels)
+	{
+		columnMap.resize(cols);
+		for (int x = 0; x < cols; x++)
+			columnMap[x] = x * labelCols / cols;
+	}
+	else
+	{
+		std::fill(maskRow.begin(), maskRow.end(), 0);
+	}
+
+	int maskLabelRow = -1;
+
+	for (int y = 0; y < rows; y++)
+	{
+		// Neighbouring color rows usually map to the same label row, the mask is only rebuilt when it changes
+		int labelRow = y * labelRows / rows;
+		if (labels && labelRow != maskLabelRow)
+		{
+			const uint16_t* labelPtr = labels + labelRow * labelCols;
+			for (int x = 0; x < cols; x++)
+			{
+				uint8_t value = labelPtr[columnMap[x]] == userID ? 0xFF : 0;
+				maskRow[3 * x] = value;
+				maskRow[3 * x + 1] = value;
+				maskRow[3 * x + 2] = value;
+			}
+			maskLabelRow = labelRow;
+		}
+
+		applyMask(color + y * rowSize, background ? background + y * rowSize : NULL, maskRow.data(), output + y * rowSize, rowSize);
+	}
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	lastTime.store(elapsed.count());
+}
+
+void PrivacyFilter::blur(const uint8_t* color, int cols, int rows, int radius)
+{
+	const int rowSize = cols * 3;
+	const int window = 2 * radius + 1;
+	// sum * reciprocal >> 16 is sum / window
+	const uint16_t reciprocal = (uint16_t)((65536 + window / 2) / window);
+
+	blurred.resize(rowSize * rows);
+	vertical.resize(rowSize * rows);
+	columnSums.assign(rowSize, 0);
+
+	// Vertical pass, edges are repeated
+	for (int k = -radius; k <= radius; k++)
+	{
+		const uint8_t* row = color + (std::min)((std::max)(k, 0), rows - 1) * rowSize;
+		for (int i = 0; i < rowSize; i++)
+			columnSums[i] += row[i];
+	}
+
+	for (int y = 0; y < rows; y++)
+	{
+		uint8_t* out = vertical.data() + y * rowSize;
+		const uint8_t* added = color + (std::min)(y + radius + 1, rows - 1) * rowSize;
+		const uint8_t* removed = color + (std::max)(y - radius, 0) * rowSize;
+		uint16_t* sums = columnSums.data();
+		int i = 0;
+
+#ifdef PRIVACY_SSE
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i factor = _mm_set1_epi16((short)reciprocal);
+
+		for (; i + 16 <= rowSize; i += 16)
+		{
+			__m128i sumLow = _mm_loadu_si128((const __m128i*)(sums + i));
+			__m128i sumHigh = _mm_loadu_si128((const __m128i*)(sums + i + 8));
+
+			__m128i average = _mm_packus_epi16(_mm_mulhi_epu16(sumLow, factor), _mm_mulhi_epu16(sumHigh, factor));
+			_mm_storeu_si128((__m128i*)(out + i), average);
+
+			__m128i add = _mm_loadu_si128((const __m128i*)(added + i));
+			__m128i remove = _mm_loadu_si128((const __m128i*)(removed + i));
+			sumLow = _mm_sub_epi16(_mm_add_epi16(sumLow, _mm_unpacklo_epi8(add, zero)), _mm_unpacklo_epi8(remove, zero));
+			sumHigh = _mm_sub_epi16(_mm_add_epi16(sumHigh, _mm_unpackhi_epi8(add, zero)), _mm_unpackhi_epi8(remove, zero));
+
+			_mm_storeu_si128((__m128i*)(sums + i), sumLow);
+			_mm_storeu_si128((__m128i*)(sums + i + 8), sumHigh);
+		}
+#endif
+
+		for (; i < rowSize; i++)
+		{
+			out[i] = (uint8_t)((sums[i] * (uint32_t)reciprocal) >> 16);
+			sums[i] = sums[i] + added[i] - removed[i];
+		}
+	}
+
+	// Horizontal pass on a copy of the row with the edges repeated, so the inner loop has no clamping.
+	// The three channels run side by side.
+	padded.resize((cols + 2 * radius + 1) * 3);
+
+	for (int y = 0; y < rows; y++)
+	{
+		const uint8_t* in = vertical.data() + y * rowSize;
+		uint8_t* out = blurred.data() + y * rowSize;
+		uint8_t* row = padded.data();
+
+		for (int k = 0; k < radius; k++)
+		{
+			memcpy(row + k * 3, in, 3);
+			memcpy(row + (radius + cols + k) * 3, in + rowSize - 3, 3);
+		}
+		memcpy(row + radius * 3, in, rowSize);
+		memcpy(row + (2 * radius + cols) * 3, in + rowSize - 3, 3);
+
+		uint32_t sum0 = 0;
+		uint32_t sum1 = 0;
+		uint32_t sum2 = 0;
+		for (int k = 0; k < window; k++)
+		{
+			sum0 += row[3 * k];
+			sum1 += row[3 * k + 1];
+			sum2 += row[3 * k + 2];
+		}
+
+		const uint8_t* removed = row;
+		const uint8_t* added = row + window * 3;
+		for (int x = 0; x < cols; x++, out += 3, added += 3, removed += 3)
+		{
+			out[0] = (uint8_t)((sum0 * reciprocal) >> 16);
+			out[1] = (uint8_t)((sum1 * reciprocal) >> 16);
+			out[2] = (uint8_t)((sum2 * reciprocal) >> 16);
+			sum0 += added[0] - removed[0];
+			sum1 += added[1] - removed[1];
+			sum2 += added[2] - removed[2];
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+typedef enum
+{
+	PRIVACY_OFF = 0,
+	PRIVACY_BLANK = 1,
+	PRIVACY_BLUR = 2
+} PrivacyMode;
+
+// Hides everything in a color frame that is not the patient, using the UserTracker label map.
+// Other people in the room are hidden like the background.
+// The mask is built one row at a time and applied with AVX2 when the CPU has it, SSE2 otherwise.
+// The blur is a separable box blur: the vertical pass keeps running column sums in 16 bit lanes,
+// and both passes divide by multiplying with a fixed point reciprocal. Buffers are reused between
+// frames, so at a constant resolution apply() does not allocate. It runs in the color callback.
+class PrivacyFilter
+{
+public:
+	PrivacyFilter();
+
+	// Can be changed from another thread
+	void setMode(PrivacyMode mode) { this->mode.store(mode); }
+	PrivacyMode getMode() const { return (PrivacyMode)mode.load(); }
+	void setBlurRadius(int radius) { blurRadius.store(radius); }
+
+	// color and output are 3 bytes per pixel. Only the pixels labelled userID are kept. The label map
+	// may have another resolution and is scaled with nearest neighbour; if labels is NULL or userID
+	// is 0 the whole frame is hidden.
+	void apply(const uint8_t* color, int cols, int rows, const uint16_t* labels, int labelCols, int labelRows, int userID, uint8_t* output);
+
+	// Time of the last apply() in ms
+	float getLastTime() const { return lastTime.load(); }
+
+private:
+	std::atomic<int> mode;
+	std::atomic<int> blurRadius;
+	std::atomic<float> lastTime;
+
+	std::vector<int> columnMap; // Label column of every color column
+	std::vector<uint8_t> maskRow; // 0xFF for the 3 bytes of every pixel of the user
+	std::vector<uint8_t> blurred;
+	std::vector<uint8_t> vertical;
+	std::vector<uint16_t> columnSums;
+	std::vector<uint8_t> padded; // One row with the edges repeated
+
+	void blur(const uint8_t* color, int cols, int rows, int radius);
+};
@@ -0,0 +1,99 @@
+#include "RealFFT.h"
+
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+RealFFT::RealFFT(int size) :
+	size(size),
+	half(size / 2),
+	bitReverse(size / 2),
+	twiddleRe(size / 4),
+	twiddleIm(size / 4),
+	splitRe(size / 2 + 1),
+	splitIm(size / 2 + 1),
+	re(size / 2),
+	im(size / 2)
+{
+	int bits = 0;
+	while ((1 << bits) < half)
+		bits++;
+
+	for (int i = 0; i < half; i++)
+	{
+		int reversed = 0;
+		for (int b = 0; b < bits; b++)
+		{
+			if (i & (1 << b))
+				reversed |= 1 << (bits - 1 - b);
+		}
+		bitReverse[i] = reversed;
+	}
+
+	for (int k = 0; k < half / 2; k++)
+	{
+		twiddleRe[k] = (float)cos(-2 * PI * k / half);
+		twiddleIm[k] = (float)sin(-2 * PI * k / half);
+	}
+
+	for (int k = 0; k <= half; k++)
+	{
+		splitRe[k] = (float)cos(-2 * PI * k / size);
+		splitIm[k] = (float)sin(-2 * PI * k / size);
+	}
+}
+
+void RealFFT::magnitude(const float* input, float* magnitude)
+{
+	// Even samples go in the real part and odd samples in the imaginary part
+	for (int i = 0; i < half; i++)
+	{
+		re[bitReverse[i]] = input[2 * i];
+		im[bitReverse[i]] = input[2 * i + 1];
+	}
+
+	// Iterative radix-2 FFT of size half
+	for (int length = 2; length <= half; length <<= 1)
+	{
+		int step = half / length;
+		int halfLength = length / 2;
+
+		for (int start = 0; start < half; start += length)
+		{
+			for (int k = 0; k < halfLength; k++)
+			{
+				float wr = twiddleRe[k * step];
+				float wi = twiddleIm[k * step];
+
+				int a = start + k;
+				int b = a + halfLength;
+
+				float tr = re[b] * wr - im[b] * wi;
+				float ti = re[b] * wi + im[b] * wr;
+
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+
+	// Split the packed spectrum Z into the spectrum X of the real signal:
+	// X[k] = (Z[k] + conj(Z[half - k])) / 2 - i * exp(-2 pi i k / size) * (Z[k] - conj(Z[half - k])) / 2
+	for (int k = 0; k <= half; k++)
+	{
+		int a = k % half;
+		int b = (half - k) % half;
+
+		float evenRe = (re[a] + re[b]) * 0.5f;
+		float evenIm = (im[a] - im[b]) * 0.5f;
+		float oddRe = (im[a] + im[b]) * 0.5f;
+		float oddIm = (re[b] - re[a]) * 0.5f;
+
+		float xr = evenRe + oddRe * splitRe[k] - oddIm * splitIm[k];
+		float xi = evenIm + oddRe * splitIm[k] + oddIm * splitRe[k];
+
+		magnitude[k] = std::sqrt(xr * xr + xi * xi);
+	}
+}
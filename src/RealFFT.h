@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+// Forward FFT of a real signal with a fixed power of two size.
+// Twiddle factors and the bit reversal table are computed once when the plan is created,
+// so transforms don't allocate or call sin/cos.
+// The real signal is packed into a complex signal of half the size, transformed, then split.
+class RealFFT
+{
+public:
+	RealFFT(int size);
+
+	int getSize() const { return size; }
+
+	// input has getSize() samples, magnitude receives getSize() / 2 + 1 bins
+	void magnitude(const float* input, float* magnitude);
+
+private:
+	int size;
+	int half;
+
+	std::vector<int> bitReverse;
+	std::vector<float> twiddleRe; // exp(-2 pi i k / half)
+	std::vector<float> twiddleIm;
+	std::vector<float> splitRe; // exp(-2 pi i k / size)
+	std::vector<float> splitIm;
+
+	std::vector<float> re;
+	std::vector<float> im;
+};
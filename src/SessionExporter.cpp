@@ -0,0 +1,279 @@
+#include "SessionExporter.h"
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+
+SessionExporter::SessionExporter() :
+	framebuffer(0),
+	colorRenderbuffer(0),
+	width(0),
+	height(0)
+{
+	memset(pixelBuffers, 0, sizeof(pixelBuffers));
+	memset(fences, 0, sizeof(fences));
+}
+
+SessionExporter::~SessionExporter()
+{
+	// Encoding tasks refer to the pending frames
+	workers.wait();
+}
+
+bool SessionExporter::createTargets(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	GLCall(glGenFramebuffers(1, &framebuffer));
+	GLCall(glGenRenderbuffers(1, &colorRenderbuffer));
+	GLCall(glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer));
+	GLCall(glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height));
+	GLCall(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+	GLCall(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer));
+	GLCall(GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Export framebuffer incomplete (" << status << ")" << std::endl;
+		return false;
+	}
+
+	GLCall(glGenBuffers(EXPORT_READBACK_COUNT, pixelBuffers));
+	for (int i = 0; i < EXPORT_READBACK_COUNT; i++)
+	{
+		GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]));
+		GLCall(glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ));
+	}
+	GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+	return true;
+}
+
+void SessionExporter::releaseTargets()
+{
+	for (int i = 0; i < EXPORT_READBACK_COUNT; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+
+	if (framebuffer)
+	{
+		GLCall(glDeleteFramebuffers(1, &framebuffer));
+		GLCall(glDeleteRenderbuffers(1, &colorRenderbuffer));
+		GLCall(glDeleteBuffers(EXPORT_READBACK_COUNT, pixelBuffers));
+		framebuffer = 0;
+		colorRenderbuffer = 0;
+		memset(pixelBuffers, 0, sizeof(pixelBuffers));
+	}
+}
+
+bool SessionExporter::exportSession(const std::vector<SessionFrame>& session, const std::vector<JointFrame>& trainer,
+	const std::string& path, int width, int height, int quality)
+{
+	timing = ExportTiming();
+
+	if (session.empty())
+	{
+		std::cout << "The session has no frames to export" << std::endl;
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	// The frame rate the patient was tracked at, from the sensor timestamps when the session has them
+	float framesPerSecond = EXPORT_DEFAULT_FPS;
+	uint64_t first = session.front().patient.sensorTimestamp;
+	uint64_t last = session.back().patient.sensorTimestamp;
+	if (session.size() > 1 && first != 0 && last > first)
+		framesPerSecond = (std::max)(1.0f, (std::min)((session.size() - 1) * 1000000.0f / (last - first), 120.0f));
+
+	GLint previousFramebuffer = 0;
+	GLint previousViewport[4];
+	GLCall(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer));
+	GLCall(glGetIntegerv(GL_VIEWPORT, previousViewport));
+
+	if (!createTargets(width, height) || !writer.open(path, width, height, framesPerSecond))
+	{
+		releaseTargets();
+		return false;
+	}
+
+	skeletonRenderer.init(skeletonBones, BONE_COUNT);
+	encoder.reset(new JpegEncoder(quality));
+
+	// Enough frames in flight to keep every worker busy
+	size_t maxPending = workers.getThreadCount() * 2 + 2;
+	int frameCount = (int)session.size();
+
+	for (int i = 0; i < frameCount; i++)
+	{
+		int buffer = i % EXPORT_READBACK_COUNT;
+
+		renderFrame(session[i], trainer);
+
+		GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[buffer]));
+		GLCall(glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0));
+		GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+		GLCall(fences[buffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+
+		// The oldest frame in the ring has had the time of two others to arrive
+		if (i >= EXPORT_READBACK_COUNT - 1)
+			readBack((i + 1) % EXPORT_READBACK_COUNT);
+
+		writeEncoded(maxPending);
+	}
+
+	// The frames still in the ring, oldest first
+	for (int i = (std::max)(0, frameCount - EXPORT_READBACK_COUNT + 1); i < frameCount; i++)
+		readBack(i % EXPORT_READBACK_COUNT);
+
+	workers.wait();
+	writeEncoded(0);
+	timing.frames = writer.getFrameCount();
+	writer.close();
+
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer));
+	GLCall(glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]));
+	skeletonRenderer.release();
+	releaseTargets();
+
+	timing.seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	timing.sessionSeconds = frameCount / framesPerSecond;
+	std::cout << "Exported " << timing.frames << " frames to " << path << " in " << timing.seconds << " s, "
+		<< timing.sessionSeconds / (std::max)(timing.seconds, 0.001f) << "x real time" << std::endl;
+
+	return timing.frames > 0;
+}
+
+// Patient and trainer like the live overlay, the sessions hold no video so the background is plain
+void SessionExporter::renderFrame(const SessionFrame& frame, const std::vector<JointFrame>& trainer)
+{
+	static const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	static const float green[4] = { 0.0f, 1.0f, 0.0f, 1.0f };
+	static const float orange[4] = { 1.0f, 0.41f, 0.0f, 1.0f };
+
+	GLCall(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+	GLCall(glViewport(0, 0, width, height));
+	GLCall(glClearColor(0.1f, 0.1f, 0.1f, 1.0f));
+	GLCall(glClear(GL_COLOR_BUFFER_BIT));
+
+	SkeletonJoint joints[SKELETON_JOINT_COUNT];
+
+	skeletonRenderer.begin();
+
+	if (frame.trainerFrame < trainer.size())
+	{
+		const JointFrame& trainerFrame = trainer[frame.trainerFrame];
+		for (int i = 0; i < SKELETON_JOINT_COUNT; i++)
+		{
+			joints[i].x = trainerFrame.joints[i].x;
+			joints[i].y = trainerFrame.joints[i].y;
+			joints[i].confidence = trainerFrame.confidence[i];
+			joints[i].unused = 0.0f;
+		}
+		skeletonRenderer.add(joints, orange, orange);
+	}
+
+	for (int i = 0; i < SKELETON_JOINT_COUNT; i++)
+	{
+		joints[i].x = frame.patient.joints[i].x;
+		joints[i].y = frame.patient.joints[i].y;
+		joints[i].confidence = frame.patient.confidence[i];
+		joints[i].unused = 0.0f;
+	}
+	skeletonRenderer.add(joints, white, green);
+
+	// Sized for the output, 4 pixel lines at 480 rows
+	skeletonRenderer.render((std::max)(2.0f, height / 120.0f), (std::max)(4.0f, height / 60.0f));
+
+	// Score along the bottom edge, from red at 0 to green at 100
+	float score = (std::min)(frame.score, (uint8_t)100) / 100.0f;
+	GLCall(glEnable(GL_SCISSOR_TEST));
+	GLCall(glScissor(0, 0, (GLsizei)(width * score), (std::max)(4, height / 40)));
+	GLCall(glClearColor(1.0f - score, score, 0.0f, 1.0f));
+	GLCall(glClear(GL_COLOR_BUFFER_BIT));
+	GLCall(glDisable(GL_SCISSOR_TEST));
+}
+
+void SessionExporter::readBack(int buffer)
+{
+	if (fences[buffer])
+	{
+		GLCall(glClientWaitSync(fences[buffer], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000));
+		glDeleteSync(fences[buffer]);
+		fences[buffer] = 0;
+	}
+
+	std::shared_ptr<PendingFrame> frame = std::make_shared<PendingFrame>();
+	size_t size = (size_t)width * height * 4;
+
+	GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[buffer]));
+	GLCall(const uint8_t* mapped = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+	if (mapped)
+	{
+		frame->pixels.assign(mapped, mapped + size);
+		GLCall(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+	}
+	else
+	{
+		// Keeps the frame count right, the frame stays black
+		std::cout << "Mapping an export pixel buffer failed" << std::endl;
+		frame->pixels.assign(size, 0);
+	}
+	GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pending.push_back(frame);
+	}
+
+	const JpegEncoder* jpeg = encoder.get();
+	int frameWidth = width;
+	int frameHeight = height;
+	workers.submit([this, frame, jpeg, frameWidth, frameHeight]
+	{
+		std::vector<uint8_t> output;
+		jpeg->encode(frame->pixels.data(), frameWidth, frameHeight, output);
+
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			frame->jpeg.swap(output);
+			frame->pixels = std::vector<uint8_t>();
+			frame->encoded = true;
+		}
+		frameEncoded.notify_all();
+	});
+}
+
+// Writes the encoded frames at the front, waits while more than maxPending are in flight
+void SessionExporter::writeEncoded(size_t maxPending)
+{
+	std::unique_lock<std::mutex> lock(pendingMutex);
+
+	while (!pending.empty())
+	{
+		if (!pending.front()->encoded)
+		{
+			if (pending.size() <= maxPending)
+				return;
+
+			frameEncoded.wait(lock);
+			continue;
+		}
+
+		std::shared_ptr<PendingFrame> frame = pending.front();
+		pending.pop_front();
+
+		lock.unlock();
+		writer.addFrame(frame->jpeg);
+		lock.lock();
+	}
+}
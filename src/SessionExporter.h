@@ -0,0 +1,71 @@
+#pragma once
+
+#include "NuitrackGL.h"
+#include "JpegEncoder.h"
+#include "AviWriter.h"
+#include "WorkerPool.h"
+
+#include <memory>
+#include <deque>
+
+#define EXPORT_READBACK_COUNT 3 // Frames rendered before the oldest is read back
+#define EXPORT_DEFAULT_FPS 30.0f
+
+struct ExportTiming
+{
+	int frames = 0;
+	float seconds = 0.0f;
+	float sessionSeconds = 0.0f; // Length of the session at its own frame rate
+};
+
+// Renders a recorded session into an offscreen framebuffer and writes it as a Motion JPEG AVI,
+// the patient and the trainer frame they were scored against burned in, with the score as a bar.
+// Nothing is drawn to a window, so it runs on a hidden context as well as between two frames of
+// the application. Frames are read back into a ring of pixel buffers and only mapped a few
+// frames later, so the GPU is never waited on. The JPEG encoding runs on a worker pool, and the
+// encoded frames are written in order as they complete.
+class SessionExporter final
+{
+public:
+	SessionExporter();
+	~SessionExporter();
+
+	// Needs a current GL context, returns false when nothing was written
+	bool exportSession(const std::vector<SessionFrame>& session, const std::vector<JointFrame>& trainer,
+		const std::string& path, int width, int height, int quality = 85);
+
+	const ExportTiming& getTiming() const { return timing; }
+
+private:
+	// A frame on its way from the pixel buffer to the file
+	struct PendingFrame
+	{
+		std::vector<uint8_t> pixels;
+		std::vector<uint8_t> jpeg;
+		bool encoded = false;
+	};
+
+	GLuint framebuffer;
+	GLuint colorRenderbuffer;
+	GLuint pixelBuffers[EXPORT_READBACK_COUNT];
+	GLsync fences[EXPORT_READBACK_COUNT];
+	int width;
+	int height;
+
+	SkeletonRenderer skeletonRenderer;
+	WorkerPool workers;
+	std::unique_ptr<JpegEncoder> encoder;
+	AviWriter writer;
+
+	std::deque<std::shared_ptr<PendingFrame>> pending;
+	std::mutex pendingMutex;
+	std::condition_variable frameEncoded;
+
+	ExportTiming timing;
+
+	bool createTargets(int width, int height);
+	void releaseTargets();
+	void renderFrame(const SessionFrame& frame, const std::vector<JointFrame>& trainer);
+	void readBack(int buffer);
+	void writeEncoded(size_t maxPending);
+};
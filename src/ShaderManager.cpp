@@ -0,0 +1,249 @@
+#include "ShaderManager.h"
+
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <direct.h>
+
+// ARB_get_program_binary, core since 4.1 and not in the 3.3 glad loader
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+static GetProgramBinaryProc getProgramBinary = NULL;
+static ProgramBinaryProc programBinary = NULL;
+static ProgramParameteriProc programParameteri = NULL;
+
+std::string ShaderManager::cacheDirectory;
+std::string ShaderManager::driver;
+bool ShaderManager::binariesSupported = false;
+int ShaderManager::loadedCount = 0;
+int ShaderManager::compiledCount = 0;
+float ShaderManager::prewarmMs = 0.0f;
+
+// Function statics, the registrations run during static initialization of other files
+static std::vector<const ShaderProgramSource*>& getRegistry()
+{
+	static std::vector<const ShaderProgramSource*> registry;
+	return registry;
+}
+
+static std::map<const ShaderProgramSource*, int>& getPrograms()
+{
+	static std::map<const ShaderProgramSource*, int> programs;
+	return programs;
+}
+
+// FNV-1a, only has to tell sources and drivers apart
+static uint64_t hashString(uint64_t hash, const char* text)
+{
+	for (; *text; text++)
+	{
+		hash ^= (unsigned char)*text;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void ShaderManager::init(const std::string& cacheDirectory)
+{
+	ShaderManager::cacheDirectory = cacheDirectory;
+
+	driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+	getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+	programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+	programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+
+	// Drivers can have the entry points and still offer no binary format
+	GLint formats = 0;
+	if (getProgramBinary && programBinary && programParameteri)
+	{
+		GLCall(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+	}
+	binariesSupported = formats > 0;
+
+	if (binariesSupported)
+		_mkdir(cacheDirectory.c_str());
+	else
+		std::cout << "Program binaries are not supported, shaders are compiled every run" << std::endl;
+}
+
+void ShaderManager::registerProgram(const ShaderProgramSource& source)
+{
+	getRegistry().push_back(&source);
+}
+
+void ShaderManager::prewarm()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (const ShaderProgramSource* source : getRegistry())
+		getProgram(*source);
+
+	prewarmMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Shaders ready in " << prewarmMs << " ms, " << loadedCount << " from the cache, " << compiledCount << " compiled" << std::endl;
+}
+
+int ShaderManager::getProgram(const ShaderProgramSource& source)
+{
+	std::map<const ShaderProgramSource*, int>& programs = getPrograms();
+	auto found = programs.find(&source);
+	if (found != programs.end())
+		return found->second;
+
+	std::string path = binariesSupported ? getCachePath(source) : std::string();
+
+	GLCall(int program = glCreateProgram());
+	if (binariesSupported && load(path, program))
+	{
+		loadedCount++;
+	}
+	else
+	{
+		GLCall(glDeleteProgram(program));
+		program = compile(source);
+		compiledCount++;
+
+		if (binariesSupported)
+			save(path, program);
+	}
+
+	programs[&source] = program;
+	return program;
+}
+
+void ShaderManager::release()
+{
+	for (const auto& entry : getPrograms())
+	{
+		GLCall(glDeleteProgram(entry.second));
+	}
+	getPrograms().clear();
+}
+
+int ShaderManager::compile(const ShaderProgramSource& source)
+{
+	GLCall(int vertexShader = glCreateShader(GL_VERTEX_SHADER));
+	GLCall(glShaderSource(vertexShader, source.vertexSourceCount, source.vertexSources, NULL));
+	GLCall(glCompileShader(vertexShader));
+	// check for shader compile errors
+	int success;
+	char infoLog[512];
+	GLCall(glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success));
+	if (!success)
+	{
+		GLCall(glGetShaderInfoLog(vertexShader, 512, NULL, infoLog));
+		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED " << source.name << "\n" << infoLog << std::endl;
+	}
+	// fragment shader
+	GLCall(int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
+	GLCall(glShaderSource(fragmentShader, source.fragmentSourceCount, source.fragmentSources, NULL));
+	GLCall(glCompileShader(fragmentShader));
+	// check for shader compile errors
+	GLCall(glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success));
+	if (!success)
+	{
+		GLCall(glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog));
+		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED " << source.name << "\n" << infoLog << std::endl;
+	}
+	// link shaders
+	GLCall(int program = glCreateProgram());
+	GLCall(glAttachShader(program, vertexShader));
+	GLCall(glAttachShader(program, fragmentShader));
+	if (binariesSupported)
+	{
+		GLCall(programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+	}
+	GLCall(glLinkProgram(program));
+	// check for linking errors
+	GLCall(glGetProgramiv(program, GL_LINK_STATUS, &success));
+	if (!success) {
+		GLCall(glGetProgramInfoLog(program, 512, NULL, infoLog));
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED " << source.name << "\n" << infoLog << std::endl;
+	}
+	GLCall(glDetachShader(program, vertexShader));
+	GLCall(glDetachShader(program, fragmentShader));
+	GLCall(glDeleteShader(vertexShader));
+	GLCall(glDeleteShader(fragmentShader));
+
+	return program;
+}
+
+// The file holds the binary format followed by the binary
+bool ShaderManager::load(const std::string& path, int program)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	GLenum format = 0;
+	file.read((char*)&format, sizeof(format));
+	std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (!file.good() && !file.eof())
+		return false;
+	if (binary.empty())
+		return false;
+
+	// A damaged file can name a format the driver does not know, which is an error that is no reason to stop
+	programBinary(program, format, binary.data(), (GLsizei)binary.size());
+	GLClearError();
+
+	// Rejected binaries fail the link status
+	GLint success = 0;
+	GLCall(glGetProgramiv(program, GL_LINK_STATUS, &success));
+	return success != 0;
+}
+
+void ShaderManager::save(const std::string& path, int program)
+{
+	GLint success = 0;
+	GLint length = 0;
+	GLCall(glGetProgramiv(program, GL_LINK_STATUS, &success));
+	GLCall(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+	if (!success || length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLCall(getProgramBinary(program, length, &length, &format, binary.data()));
+
+	std::ofstream file(path, std::ios::binary | std::ofstream::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write shader cache " << path << std::endl;
+		return;
+	}
+	file.write((const char*)&format, sizeof(format));
+	file.write(binary.data(), length);
+}
+
+// A new driver or changed sources give a new file, stale files are never read again
+std::string ShaderManager::getCachePath(const ShaderProgramSource& source)
+{
+	uint64_t hash = hashString(14695981039346656037ull, driver.c_str());
+	for (int i = 0; i < source.vertexSourceCount; i++)
+		hash = hashString(hash, source.vertexSources[i]);
+	hash = hashString(hash, "|");
+	for (int i = 0; i < source.fragmentSourceCount; i++)
+		hash = hashString(hash, source.fragmentSources[i]);
+
+	std::ostringstream path;
+	path << cacheDirectory << "/" << source.name << "_" << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+	return path.str();
+}
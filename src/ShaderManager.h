@@ -0,0 +1,61 @@
+#pragma once
+
+#include "opgl.h"
+
+#include <string>
+
+// Sources of one program. The parts of a stage are concatenated like glShaderSource does,
+// they are only read when the program is created, after every static initializer ran.
+struct ShaderProgramSource
+{
+	const char* name; // Names the cache file
+	const char* const* vertexSources;
+	int vertexSourceCount;
+	const char* const* fragmentSources;
+	int fragmentSourceCount;
+};
+
+// Creates every shader program once per process and keeps them until release().
+// The programs are registered next to their sources and linked together by prewarm() at startup,
+// so the first frame does not wait for the compiler. A linked program is saved to the cache
+// directory with glGetProgramBinary, under a hash of the driver strings and the sources, and
+// loaded back with glProgramBinary by later runs. A binary the driver rejects, an updated driver
+// or changed sources fall back to compiling, which also replaces the cached binary.
+class ShaderManager final
+{
+public:
+	// Needs a current GL context, loads the binary entry points glad was generated without
+	static void init(const std::string& cacheDirectory);
+	// Creates every registered program
+	static void prewarm();
+	// Creates the program on first use when it was not prewarmed
+	static int getProgram(const ShaderProgramSource& source);
+	// Deletes every program, needs the context still current
+	static void release();
+
+	static void registerProgram(const ShaderProgramSource& source);
+
+	static int getLoadedCount() { return loadedCount; }
+	static int getCompiledCount() { return compiledCount; }
+	static float getPrewarmMs() { return prewarmMs; }
+
+private:
+	static std::string cacheDirectory;
+	static std::string driver;
+	static bool binariesSupported;
+	static int loadedCount;
+	static int compiledCount;
+	static float prewarmMs;
+
+	static int compile(const ShaderProgramSource& source);
+	static bool load(const std::string& path, int program);
+	static void save(const std::string& path, int program);
+	static std::string getCachePath(const ShaderProgramSource& source);
+};
+
+// Registers a program for prewarm() from a static initializer in the file holding its sources
+class ShaderRegistration final
+{
+public:
+	ShaderRegistration(const ShaderProgramSource& source) { ShaderManager::registerProgram(source); }
+};
@@ -0,0 +1,100 @@
+#include "SkeletonFilter.h"
+
+#include <cmath>
+#include <algorithm>
+
+#define CONFIDENCE_THRESHOLD 0.15f
+#define MAX_PREDICTION 0.1f // Seconds, predicting further ahead overshoots
+
+static const float PI = 3.14159265358979323846f;
+
+// Smoothing factor of an exponential filter with the given cutoff frequency
+static float getAlpha(float cutoff, float dt)
+{
+	float tau = 1.0f / (2 * PI * cutoff);
+	return 1.0f / (1.0f + tau / dt);
+}
+
+SkeletonFilter::SkeletonFilter() :
+	minCutoff(1.0f),
+	beta(5.0f), // Positions are normalized to [0, 1] so beta is larger than for pixels
+	derivativeCutoff(1.0f),
+	latency(0.033f) // About one sensor frame
+{
+	clear();
+}
+
+void SkeletonFilter::setParameters(float minCutoff, float beta, float latency)
+{
+	this->minCutoff = minCutoff;
+	this->beta = beta;
+	this->latency = latency;
+}
+
+void SkeletonFilter::clear()
+{
+	for (int i = 0; i < FILTER_JOINT_COUNT; i++)
+		initialized[i] = false;
+
+	lastTime = 0;
+}
+
+void SkeletonFilter::filter(OneEuro& state, float value, float dt)
+{
+	float derivative = (value - state.value) / dt;
+	state.derivative += getAlpha(derivativeCutoff, dt) * (derivative - state.derivative);
+
+	float cutoff = minCutoff + beta * std::fabs(state.derivative);
+	state.value += getAlpha(cutoff, dt) * (value - state.value);
+}
+
+void SkeletonFilter::update(const std::vector<tdv::nuitrack::Joint>& joints, double time)
+{
+	float dt = (float)(time - lastTime);
+	int count = (std::min)((int)joints.size(), FILTER_JOINT_COUNT);
+
+	for (int i = 0; i < count; i++)
+	{
+		const tdv::nuitrack::Joint& joint = joints[i];
+
+		// Start again when a joint is lost so it doesn't slide in from its old position
+		if (joint.confidence <= CONFIDENCE_THRESHOLD)
+		{
+			initialized[i] = false;
+			continue;
+		}
+
+		if (!initialized[i] || dt <= 0)
+		{
+			x[i].value = joint.proj.x;
+			y[i].value = joint.proj.y;
+			x[i].derivative = 0;
+			y[i].derivative = 0;
+			initialized[i] = true;
+			continue;
+		}
+
+		filter(x[i], joint.proj.x, dt);
+		filter(y[i], joint.proj.y, dt);
+	}
+
+	lastTime = time;
+}
+
+void SkeletonFilter::predict(double time, std::vector<tdv::nuitrack::Joint>& joints, bool addLatency) const
+{
+	// A frame captured before the last skeleton is reached by going back along the velocity
+	float ahead = (float)(time - lastTime) + (addLatency ? latency : 0.0f);
+	ahead = (std::max)(addLatency ? 0.0f : -MAX_PREDICTION, (std::min)(ahead, MAX_PREDICTION));
+
+	int count = (std::min)((int)joints.size(), FILTER_JOINT_COUNT);
+
+	for (int i = 0; i < count; i++)
+	{
+		if (!initialized[i])
+			continue;
+
+		joints[i].proj.x = x[i].value + x[i].derivative * ahead;
+		joints[i].proj.y = y[i].value + y[i].derivative * ahead;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <nuitrack/Nuitrack.h>
+#include <vector>
+
+#define FILTER_JOINT_COUNT 25
+
+// One Euro filter (Casiez et al. 2012) on the projected position of every joint.
+// The cutoff frequency rises with speed, so the skeleton is steady when still and
+// lags little when moving. The filtered velocity is used to predict the joints
+// forward to the render time, which hides the sensor latency and lets the overlay move
+// smoothly at display refresh instead of jumping once per sensor frame.
+class SkeletonFilter
+{
+public:
+	SkeletonFilter();
+
+	// minCutoff in Hz, beta scales the cutoff with speed, latency in seconds is added to every prediction
+	void setParameters(float minCutoff, float beta, float latency);
+	void clear();
+
+	// time is in seconds
+	void update(const std::vector<tdv::nuitrack::Joint>& joints, double time);
+	// Replaces the projected x and y of joints with the filtered position predicted at time.
+	// The latency is only added when predicting to the present, not to the capture time of a frame.
+	void predict(double time, std::vector<tdv::nuitrack::Joint>& joints, bool addLatency = true) const;
+
+private:
+	struct OneEuro
+	{
+		float value;
+		float derivative;
+	};
+
+	float minCutoff;
+	float beta;
+	float derivativeCutoff;
+	float latency;
+
+	OneEuro x[FILTER_JOINT_COUNT];
+	OneEuro y[FILTER_JOINT_COUNT];
+	bool initialized[FILTER_JOINT_COUNT];
+	double lastTime;
+
+	void filter(OneEuro& state, float value, float dt);
+};
@@ -0,0 +1,355 @@
+#include "SkeletonRenderer.h"
+#include "ShaderManager.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+// Every instance is one bone of one skeleton, its four vertices are the corners of a quad
+// around the bone, one pixel wider than the line for the antialiased edge.
+static const char* boneVertexShaderSource =
+"#version 330 core\n"
+"uniform samplerBuffer joints;\n"
+"uniform isamplerBuffer bones;\n"
+"uniform int baseTexel;\n" // Start of the region drawn from
+"uniform int boneCount;\n"
+"uniform vec2 viewportSize;\n"
+"uniform float halfWidth;\n"
+"flat out vec4 color;\n"
+"flat out float boneLength;\n"
+"out vec2 local;\n" // Along and across the bone in pixels, from the first joint
+"void main()\n"
+"{\n"
+"   int skeleton = gl_InstanceID / boneCount;\n"
+"   ivec2 bone = texelFetch(bones, gl_InstanceID - skeleton * boneCount).xy;\n"
+"   int base = baseTexel + skeleton * 27;\n" // SKELETON_TEXELS
+"   vec4 a = texelFetch(joints, base + bone.x);\n"
+"   vec4 b = texelFetch(joints, base + bone.y);\n"
+"   color = texelFetch(joints, base + 25);\n"
+"   boneLength = 0.0;\n"
+"   local = vec2(0.0);\n"
+"   if (a.z <= 0.15 || b.z <= 0.15)\n"
+"   {\n"
+"       // All corners in one point outside the clip volume, nothing is drawn\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   // Projected 0-1 from the top right of the image to window pixels from the bottom left\n"
+"   vec2 start = (1.0 - a.xy) * viewportSize;\n"
+"   vec2 axis = (1.0 - b.xy) * viewportSize - start;\n"
+"   boneLength = length(axis);\n"
+"   vec2 direction = boneLength > 0.0 ? axis / boneLength : vec2(1.0, 0.0);\n"
+"   vec2 normal = vec2(-direction.y, direction.x);\n"
+"   float extent = halfWidth + 1.0;\n"
+"   vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+"   local = vec2(mix(-extent, boneLength + extent, corner.x), mix(-extent, extent, corner.y));\n"
+"   vec2 position = start + direction * local.x + normal * local.y;\n"
+"   gl_Position = vec4(position / viewportSize * 2.0 - 1.0, 0.0, 1.0);\n"
+"}\n";
+
+// Coverage from the distance to the bone segment, which gives the capsule its round ends
+static const char* boneFragmentShaderSource =
+"#version 330 core\n"
+"uniform float halfWidth;\n"
+"flat in vec4 color;\n"
+"flat in float boneLength;\n"
+"in vec2 local;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   float distance = length(vec2(local.x - clamp(local.x, 0.0, boneLength), local.y));\n"
+"   float coverage = clamp(halfWidth + 0.5 - distance, 0.0, 1.0);\n"
+"   if (coverage == 0.0)\n"
+"       discard;\n"
+"   FragColor = vec4(color.rgb, color.a * coverage);\n"
+"}\n";
+
+// Every vertex is one joint, gl_InstanceID is the skeleton
+static const char* jointVertexShaderSource =
+"#version 330 core\n"
+"layout (location = 0) in int joint;\n"
+"uniform samplerBuffer joints;\n"
+"uniform int baseTexel;\n"
+"uniform float pointSize;\n"
+"flat out vec4 color;\n"
+"void main()\n"
+"{\n"
+"   int base = baseTexel + gl_InstanceID * 27;\n" // SKELETON_TEXELS
+"   vec4 position = texelFetch(joints, base + joint);\n"
+"   color = texelFetch(joints, base + 26);\n"
+"   if (position.z <= 0.15)\n"
+"   {\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   gl_Position = vec4(1.0 - 2.0 * position.xy, 0.0, 1.0);\n"
+"   // One pixel more for the antialiased edge\n"
+"   gl_PointSize = pointSize + 1.0;\n"
+"}\n";
+
+static const char* jointFragmentShaderSource =
+"#version 330 core\n"
+"uniform float pointSize;\n"
+"flat in vec4 color;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   float distance = length(gl_PointCoord - 0.5) * (pointSize + 1.0);\n"
+"   float coverage = clamp(pointSize * 0.5 + 0.5 - distance, 0.0, 1.0);\n"
+"   if (coverage == 0.0)\n"
+"       discard;\n"
+"   FragColor = vec4(color.rgb, color.a * coverage);\n"
+"}\n";
+
+static const ShaderProgramSource boneProgramSource = { "skeleton_bone", &boneVertexShaderSource, 1, &boneFragmentShaderSource, 1 };
+static const ShaderProgramSource jointProgramSource = { "skeleton_joint", &jointVertexShaderSource, 1, &jointFragmentShaderSource, 1 };
+static ShaderRegistration boneRegistration(boneProgramSource);
+static ShaderRegistration jointRegistration(jointProgramSource);
+
+SkeletonRenderer::SkeletonRenderer() :
+	boneProgram(0),
+	jointProgram(0),
+	VAO(0),
+	jointIndexBuffer(0),
+	boneBuffer(0),
+	boneTexture(0),
+	jointBuffer(0),
+	jointTexture(0),
+	capacity(0),
+	nextRegion(0),
+	boneCount(0),
+	spriteCount(0),
+	boneBaseTexelUniformLocation(-1),
+	boneCountUniformLocation(-1),
+	viewportSizeUniformLocation(-1),
+	halfWidthUniformLocation(-1),
+	jointBaseTexelUniformLocation(-1),
+	pointSizeUniformLocation(-1),
+	skeletonCount(0)
+{
+	memset(fences, 0, sizeof(fences));
+}
+
+void SkeletonRenderer::init(const int (*bones)[2], int boneCount)
+{
+	this->boneCount = boneCount;
+
+	boneProgram = ShaderManager::getProgram(boneProgramSource);
+	jointProgram = ShaderManager::getProgram(jointProgramSource);
+
+	GLCall(boneBaseTexelUniformLocation = glGetUniformLocation(boneProgram, "baseTexel"));
+	GLCall(boneCountUniformLocation = glGetUniformLocation(boneProgram, "boneCount"));
+	GLCall(viewportSizeUniformLocation = glGetUniformLocation(boneProgram, "viewportSize"));
+	GLCall(halfWidthUniformLocation = glGetUniformLocation(boneProgram, "halfWidth"));
+	GLCall(jointBaseTexelUniformLocation = glGetUniformLocation(jointProgram, "baseTexel"));
+	GLCall(pointSizeUniformLocation = glGetUniformLocation(jointProgram, "pointSize"));
+
+	// Unit 0 and 1 hold the image and the label map
+	GLCall(glUseProgram(boneProgram));
+	GLCall(glUniform1i(glGetUniformLocation(boneProgram, "joints"), 2));
+	GLCall(glUniform1i(glGetUniformLocation(boneProgram, "bones"), 3));
+	GLCall(glUseProgram(jointProgram));
+	GLCall(glUniform1i(glGetUniformLocation(jointProgram, "joints"), 2));
+	GLCall(glUseProgram(0));
+
+	// Both joint indices of every bone, read by the bone instances
+	std::vector<GLint> boneJoints;
+	std::vector<GLint> spriteJoints;
+	for (int i = 0; i < boneCount; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			boneJoints.push_back(bones[i][j]);
+
+			// A sprite for every joint that is part of a bone
+			if (std::find(spriteJoints.begin(), spriteJoints.end(), bones[i][j]) == spriteJoints.end())
+				spriteJoints.push_back(bones[i][j]);
+		}
+	}
+	spriteCount = (int)spriteJoints.size();
+
+	GLCall(glGenBuffers(1, &boneBuffer));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, boneBuffer));
+	GLCall(glBufferData(GL_TEXTURE_BUFFER, boneJoints.size() * sizeof(GLint), boneJoints.data(), GL_STATIC_DRAW));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+	GLCall(glGenTextures(1, &boneTexture));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, boneTexture));
+	GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32I, boneBuffer));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, 0));
+
+	GLCall(glGenVertexArrays(1, &VAO));
+	GLCall(glGenBuffers(1, &jointIndexBuffer));
+	GLCall(glBindVertexArray(VAO));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, jointIndexBuffer));
+	GLCall(glBufferData(GL_ARRAY_BUFFER, spriteJoints.size() * sizeof(GLint), spriteJoints.data(), GL_STATIC_DRAW));
+	GLCall(glVertexAttribIPointer(0, 1, GL_INT, sizeof(GLint), (void*)0));
+	GLCall(glEnableVertexAttribArray(0));
+	GLCall(glBindVertexArray(0));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+	GLCall(glGenBuffers(1, &jointBuffer));
+	GLCall(glGenTextures(1, &jointTexture));
+	grow(SKELETON_INITIAL_CAPACITY);
+}
+
+void SkeletonRenderer::release()
+{
+	deleteFences();
+
+	if (boneProgram)
+	{
+		GLCall(glDeleteVertexArrays(1, &VAO));
+		GLCall(glDeleteBuffers(1, &jointIndexBuffer));
+		GLCall(glDeleteBuffers(1, &boneBuffer));
+		GLCall(glDeleteTextures(1, &boneTexture));
+		GLCall(glDeleteBuffers(1, &jointBuffer));
+		GLCall(glDeleteTextures(1, &jointTexture));
+		boneProgram = 0;
+		jointProgram = 0;
+		VAO = 0;
+		jointIndexBuffer = 0;
+		boneBuffer = 0;
+		boneTexture = 0;
+		jointBuffer = 0;
+		jointTexture = 0;
+		capacity = 0;
+	}
+}
+
+void SkeletonRenderer::deleteFences()
+{
+	for (int i = 0; i < SKELETON_REGION_COUNT; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+}
+
+void SkeletonRenderer::grow(int skeletons)
+{
+	while (capacity < skeletons)
+		capacity = capacity == 0 ? SKELETON_INITIAL_CAPACITY : capacity * 2;
+
+	// New storage, nothing the GPU reads from can be overwritten anymore
+	deleteFences();
+	nextRegion = 0;
+
+	GLsizeiptr size = (GLsizeiptr)SKELETON_REGION_COUNT * capacity * SKELETON_TEXELS * sizeof(SkeletonJoint);
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, jointBuffer));
+	GLCall(glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+	// Attach the buffer to the texture again so it covers the new size
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, jointTexture));
+	GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, jointBuffer));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, 0));
+}
+
+void SkeletonRenderer::begin()
+{
+	staging.clear();
+	skeletonCount = 0;
+}
+
+void SkeletonRenderer::add(const SkeletonJoint* joints, const float* boneColor, const float* jointColor)
+{
+	staging.insert(staging.end(), joints, joints + SKELETON_JOINT_COUNT);
+
+	// The colours are texels of the same buffer
+	SkeletonJoint color = { boneColor[0], boneColor[1], boneColor[2], boneColor[3] };
+	staging.push_back(color);
+	color = { jointColor[0], jointColor[1], jointColor[2], jointColor[3] };
+	staging.push_back(color);
+
+	skeletonCount++;
+}
+
+void SkeletonRenderer::add(const std::vector<tdv::nuitrack::Joint>& joints, const float* boneColor, const float* jointColor)
+{
+	SkeletonJoint converted[SKELETON_JOINT_COUNT];
+	for (int i = 0; i < SKELETON_JOINT_COUNT; i++)
+	{
+		converted[i].x = joints[i].proj.x;
+		converted[i].y = joints[i].proj.y;
+		converted[i].confidence = joints[i].confidence;
+		converted[i].unused = 0.0f;
+	}
+
+	add(converted, boneColor, jointColor);
+}
+
+void SkeletonRenderer::render(float lineWidth, float pointSize)
+{
+	if (skeletonCount == 0)
+		return;
+
+	if (skeletonCount > capacity)
+		grow(skeletonCount);
+
+	int region = nextRegion;
+	nextRegion = (nextRegion + 1) % SKELETON_REGION_COUNT;
+
+	// The region was drawn from SKELETON_REGION_COUNT frames ago, that is normally long done
+	if (fences[region])
+	{
+		GLCall(glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000));
+		glDeleteSync(fences[region]);
+		fences[region] = 0;
+	}
+
+	GLintptr regionSize = (GLintptr)capacity * SKELETON_TEXELS * sizeof(SkeletonJoint);
+	GLsizeiptr size = staging.size() * sizeof(SkeletonJoint);
+
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, jointBuffer));
+	GLCall(void* mapped = glMapBufferRange(GL_TEXTURE_BUFFER, region * regionSize, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	if (mapped)
+	{
+		memcpy(mapped, staging.data(), size);
+		GLCall(glUnmapBuffer(GL_TEXTURE_BUFFER));
+	}
+	else
+	{
+		std::cout << "Mapping the joint buffer failed" << std::endl;
+		GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+		return;
+	}
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+	GLCall(glActiveTexture(GL_TEXTURE2));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, jointTexture));
+	GLCall(glActiveTexture(GL_TEXTURE3));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, boneTexture));
+	GLCall(glActiveTexture(GL_TEXTURE0));
+
+	GLint viewport[4];
+	GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+	int baseTexel = region * capacity * SKELETON_TEXELS;
+
+	// The edges are blended over the image
+	GLCall(glEnable(GL_BLEND));
+	GLCall(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+	GLCall(glBindVertexArray(VAO));
+
+	GLCall(glUseProgram(boneProgram));
+	GLCall(glUniform1i(boneBaseTexelUniformLocation, baseTexel));
+	GLCall(glUniform1i(boneCountUniformLocation, boneCount));
+	GLCall(glUniform2f(viewportSizeUniformLocation, (float)viewport[2], (float)viewport[3]));
+	GLCall(glUniform1f(halfWidthUniformLocation, lineWidth * 0.5f));
+	GLCall(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, boneCount * skeletonCount));
+
+	// Joints on top of the bones
+	GLCall(glUseProgram(jointProgram));
+	GLCall(glUniform1i(jointBaseTexelUniformLocation, baseTexel));
+	GLCall(glUniform1f(pointSizeUniformLocation, pointSize));
+	GLCall(glEnable(GL_PROGRAM_POINT_SIZE));
+	GLCall(glDrawArraysInstanced(GL_POINTS, 0, spriteCount, skeletonCount));
+	GLCall(glDisable(GL_PROGRAM_POINT_SIZE));
+
+	GLCall(glBindVertexArray(0));
+	GLCall(glDisable(GL_BLEND));
+	GLCall(fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
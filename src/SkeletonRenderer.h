@@ -0,0 +1,77 @@
+#pragma once
+
+#include "opgl.h"
+
+#include <nuitrack/Nuitrack.h>
+#include <vector>
+
+#define SKELETON_JOINT_COUNT 25
+// Texels per skeleton in the joint buffer: the joints, then the bone and the joint colour
+#define SKELETON_TEXELS (SKELETON_JOINT_COUNT + 2)
+#define SKELETON_REGION_COUNT 3 // Frames the GPU can still be reading while the next is written
+#define SKELETON_INITIAL_CAPACITY 8 // Skeletons per region before the buffer grows
+
+// One texel of the joint buffer, as Nuitrack projects the joint (0-1, from the top right)
+struct SkeletonJoint
+{
+	float x;
+	float y;
+	float confidence;
+	float unused;
+};
+
+// Draws every skeleton of a frame with one instanced call for the bones and one for the joints.
+// Only the raw joints are uploaded, into a texture buffer. Every bone is an instance of a quad the
+// vertex shader stretches between its two joints, read through a static bone index buffer, and
+// every joint is a point sprite. The shaders map the joints to the window and cull bones with an
+// unconfident joint, so the CPU no longer builds any vertices. The fragment shaders compute the
+// coverage from the distance to the bone or joint centre in pixels, which antialiases the edges
+// and rounds the ends without relying on wide or smooth lines, which core profiles lack.
+// The joint buffer is a ring of regions, each frame is written into the next one through an
+// unsynchronized mapping, and a fence per region tells when the GPU is done reading it.
+// It doubles in size when more skeletons are added than a region holds.
+class SkeletonRenderer
+{
+public:
+	SkeletonRenderer();
+
+	// Needs a current GL context, bones are pairs of joint indices
+	void init(const int (*bones)[2], int boneCount);
+	void release();
+
+	// Skeletons are collected between begin() and render(), colours are RGBA
+	void begin();
+	void add(const SkeletonJoint* joints, const float* boneColor, const float* jointColor);
+	void add(const std::vector<tdv::nuitrack::Joint>& joints, const float* boneColor, const float* jointColor);
+
+	// Widths and sizes in pixels
+	void render(float lineWidth, float pointSize);
+
+private:
+	int boneProgram;
+	int jointProgram;
+	GLuint VAO; // Joint index of every sprite
+	GLuint jointIndexBuffer;
+	GLuint boneBuffer; // Both joint indices of every bone, static
+	GLuint boneTexture;
+	GLuint jointBuffer;
+	GLuint jointTexture;
+	int capacity; // Skeletons per region
+	GLsync fences[SKELETON_REGION_COUNT];
+	int nextRegion;
+	int boneCount;
+	int spriteCount;
+
+	int boneBaseTexelUniformLocation;
+	int boneCountUniformLocation;
+	int viewportSizeUniformLocation;
+	int halfWidthUniformLocation;
+	int jointBaseTexelUniformLocation;
+	int pointSizeUniformLocation;
+
+	std::vector<SkeletonJoint> staging;
+	int skeletonCount;
+
+	void grow(int skeletons);
+	void deleteFences();
+};
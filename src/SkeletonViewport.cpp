@@ -0,0 +1,475 @@
+#include "SkeletonViewport.h"
+#include "ShaderManager.h"
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+#define CYLINDER_SEGMENTS 12
+#define SPHERE_RINGS 8
+#define SPHERE_SEGMENTS 12
+#define BONE_RADIUS 25.0f // mm
+#define JOINT_RADIUS 40.0f
+#define FLOOR_SIZE 4000.0f
+#define TIMING_RATE 0.05f
+
+#define CAMERA_BINDING 0
+
+// Shared by every program, std140 layout
+struct CameraBlock
+{
+	float view[16];
+	float projection[16];
+};
+
+// Every instance is one bone of one skeleton, a unit cylinder along z stretched between its joints.
+// The xy of a cylinder vertex is also its normal.
+static const char* boneVertexShaderSource =
+"#version 330 core\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (std140) uniform Camera { mat4 view; mat4 projection; };\n"
+"uniform samplerBuffer joints;\n"
+"uniform isamplerBuffer bones;\n"
+"uniform int boneCount;\n"
+"flat out vec4 color;\n"
+"out vec3 viewNormal;\n"
+"void main()\n"
+"{\n"
+"   int skeleton = gl_InstanceID / boneCount;\n"
+"   ivec2 bone = texelFetch(bones, gl_InstanceID - skeleton * boneCount).xy;\n"
+"   int base = skeleton * 27;\n" // VIEWPORT_TEXELS
+"   vec4 a = texelFetch(joints, base + bone.x);\n"
+"   vec4 b = texelFetch(joints, base + bone.y);\n"
+"   color = texelFetch(joints, base + 25);\n"
+"   viewNormal = vec3(0.0, 0.0, 1.0);\n"
+"   if (a.w <= 0.15 || b.w <= 0.15)\n"
+"   {\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   vec3 axis = b.xyz - a.xyz;\n"
+"   vec3 direction = length(axis) > 0.0 ? normalize(axis) : vec3(0.0, 1.0, 0.0);\n"
+"   // Any vector that is not parallel to the bone spans the cross section\n"
+"   vec3 helper = abs(direction.y) < 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);\n"
+"   vec3 u = normalize(cross(direction, helper));\n"
+"   vec3 v = cross(direction, u);\n"
+"   vec3 normal = u * position.x + v * position.y;\n"
+"   vec3 world = a.xyz + normal * 25.0 + axis * position.z;\n" // BONE_RADIUS
+"   viewNormal = mat3(view) * normal;\n"
+"   gl_Position = projection * view * vec4(world, 1.0);\n"
+"}\n";
+
+// Every instance is one joint of one skeleton, a unit sphere whose positions are also its normals
+static const char* jointVertexShaderSource =
+"#version 330 core\n"
+"layout (location = 0) in vec3 position;\n"
+"layout (std140) uniform Camera { mat4 view; mat4 projection; };\n"
+"uniform samplerBuffer joints;\n"
+"flat out vec4 color;\n"
+"out vec3 viewNormal;\n"
+"void main()\n"
+"{\n"
+"   int skeleton = gl_InstanceID / 25;\n" // VIEWPORT_JOINT_COUNT
+"   int base = skeleton * 27;\n"
+"   vec4 joint = texelFetch(joints, base + gl_InstanceID - skeleton * 25);\n"
+"   color = texelFetch(joints, base + 26);\n"
+"   viewNormal = mat3(view) * position;\n"
+"   if (joint.w <= 0.15)\n"
+"   {\n"
+"       gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+"       return;\n"
+"   }\n"
+"   gl_Position = projection * view * vec4(joint.xyz + position * 40.0, 1.0);\n" // JOINT_RADIUS
+"}\n";
+
+// Light comes from the camera, the view is mirrored so both sides are lit
+static const char* shadedFragmentShaderSource =
+"#version 330 core\n"
+"flat in vec4 color;\n"
+"in vec3 viewNormal;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   float light = 0.35 + 0.65 * abs(normalize(viewNormal).z);\n"
+"   FragColor = vec4(color.rgb * light, color.a);\n"
+"}\n";
+
+// A square on the floor plane around the point below the target, corners from gl_VertexID
+static const char* floorVertexShaderSource =
+"#version 330 core\n"
+"layout (std140) uniform Camera { mat4 view; mat4 projection; };\n"
+"uniform vec3 floorCenter;\n"
+"uniform vec3 floorNormal;\n"
+"out vec2 planar;\n" // Position on the floor in mm from the center
+"void main()\n"
+"{\n"
+"   vec3 helper = abs(floorNormal.z) < 0.9 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);\n"
+"   vec3 u = normalize(cross(floorNormal, helper));\n"
+"   vec3 v = cross(floorNormal, u);\n"
+"   planar = (vec2(gl_VertexID & 1, gl_VertexID >> 1) - 0.5) * 4000.0;\n" // FLOOR_SIZE
+"   gl_Position = projection * view * vec4(floorCenter + u * planar.x + v * planar.y, 1.0);\n"
+"}\n";
+
+// Antialiased grid lines every half metre, fading out towards the edges
+static const char* floorFragmentShaderSource =
+"#version 330 core\n"
+"in vec2 planar;\n"
+"out vec4 FragColor;\n"
+"void main()\n"
+"{\n"
+"   vec2 cell = planar / 500.0;\n"
+"   vec2 distance = abs(fract(cell - 0.5) - 0.5) / fwidth(cell);\n"
+"   float line = 1.0 - min(min(distance.x, distance.y), 1.0);\n"
+"   float fade = 1.0 - smoothstep(0.6, 1.0, length(planar) / 2000.0);\n"
+"   FragColor = vec4(mix(vec3(0.2), vec3(0.6), line), 0.9 * fade);\n"
+"}\n";
+
+static const ShaderProgramSource boneProgramSource = { "viewport_bone", &boneVertexShaderSource, 1, &shadedFragmentShaderSource, 1 };
+static const ShaderProgramSource jointProgramSource = { "viewport_joint", &jointVertexShaderSource, 1, &shadedFragmentShaderSource, 1 };
+static const ShaderProgramSource floorProgramSource = { "viewport_floor", &floorVertexShaderSource, 1, &floorFragmentShaderSource, 1 };
+static ShaderRegistration boneRegistration(boneProgramSource);
+static ShaderRegistration jointRegistration(jointProgramSource);
+static ShaderRegistration floorRegistration(floorProgramSource);
+
+SkeletonViewport::SkeletonViewport() :
+	boneProgram(0),
+	jointProgram(0),
+	floorProgram(0),
+	cylinderVAO(0),
+	cylinderBuffer(0),
+	cylinderVertexCount(0),
+	sphereVAO(0),
+	sphereBuffer(0),
+	sphereIndexBuffer(0),
+	sphereIndexCount(0),
+	floorVAO(0),
+	cameraBuffer(0),
+	boneBuffer(0),
+	boneTexture(0),
+	jointBuffer(0),
+	jointTexture(0),
+	boneCount(0),
+	boneCountUniformLocation(-1),
+	floorCenterUniformLocation(-1),
+	floorNormalUniformLocation(-1),
+	yaw(0.0f),
+	pitch(0.0f),
+	distance(3000.0f),
+	skeletonCount(0),
+	nextQuery(0),
+	gpuMs(0.0f)
+{
+	memset(target, 0, sizeof(target));
+	memset(floorPoint, 0, sizeof(floorPoint));
+	memset(floorNormal, 0, sizeof(floorNormal));
+	memset(queries, 0, sizeof(queries));
+	memset(queryPending, 0, sizeof(queryPending));
+}
+
+void SkeletonViewport::init(const int (*bones)[2], int boneCount)
+{
+	this->boneCount = boneCount;
+
+	boneProgram = ShaderManager::getProgram(boneProgramSource);
+	jointProgram = ShaderManager::getProgram(jointProgramSource);
+	floorProgram = ShaderManager::getProgram(floorProgramSource);
+
+	GLCall(boneCountUniformLocation = glGetUniformLocation(boneProgram, "boneCount"));
+	GLCall(floorCenterUniformLocation = glGetUniformLocation(floorProgram, "floorCenter"));
+	GLCall(floorNormalUniformLocation = glGetUniformLocation(floorProgram, "floorNormal"));
+
+	// The camera block of every program reads from the same buffer
+	int programs[3] = { boneProgram, jointProgram, floorProgram };
+	for (int i = 0; i < 3; i++)
+	{
+		GLCall(GLuint block = glGetUniformBlockIndex(programs[i], "Camera"));
+		GLCall(glUniformBlockBinding(programs[i], block, CAMERA_BINDING));
+	}
+
+	GLCall(glGenBuffers(1, &cameraBuffer));
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer));
+	GLCall(glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW));
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+	// Unit 2 and 3 like the 2D overlay, the joints and the bone indices
+	GLCall(glUseProgram(boneProgram));
+	GLCall(glUniform1i(glGetUniformLocation(boneProgram, "joints"), 2));
+	GLCall(glUniform1i(glGetUniformLocation(boneProgram, "bones"), 3));
+	GLCall(glUseProgram(jointProgram));
+	GLCall(glUniform1i(glGetUniformLocation(jointProgram, "joints"), 2));
+	GLCall(glUseProgram(0));
+
+	// Side of a unit cylinder as a triangle strip
+	std::vector<float> cylinder;
+	for (int i = 0; i <= CYLINDER_SEGMENTS; i++)
+	{
+		float angle = 2.0f * 3.14159265f * i / CYLINDER_SEGMENTS;
+		for (int z = 0; z < 2; z++)
+		{
+			cylinder.push_back(std::cos(angle));
+			cylinder.push_back(std::sin(angle));
+			cylinder.push_back((float)z);
+		}
+	}
+	cylinderVertexCount = (int)cylinder.size() / 3;
+
+	// Unit sphere from rings of latitude
+	std::vector<float> sphere;
+	std::vector<GLuint> sphereIndices;
+	for (int ring = 0; ring <= SPHERE_RINGS; ring++)
+	{
+		float latitude = 3.14159265f * ring / SPHERE_RINGS;
+		for (int segment = 0; segment <= SPHERE_SEGMENTS; segment++)
+		{
+			float longitude = 2.0f * 3.14159265f * segment / SPHERE_SEGMENTS;
+			sphere.push_back(std::sin(latitude) * std::cos(longitude));
+			sphere.push_back(std::cos(latitude));
+			sphere.push_back(std::sin(latitude) * std::sin(longitude));
+		}
+	}
+	for (int ring = 0; ring < SPHERE_RINGS; ring++)
+	{
+		for (int segment = 0; segment < SPHERE_SEGMENTS; segment++)
+		{
+			GLuint first = ring * (SPHERE_SEGMENTS + 1) + segment;
+			GLuint below = first + SPHERE_SEGMENTS + 1;
+			GLuint quad[6] = { first, below, first + 1, first + 1, below, below + 1 };
+			sphereIndices.insert(sphereIndices.end(), quad, quad + 6);
+		}
+	}
+	sphereIndexCount = (int)sphereIndices.size();
+
+	GLCall(glGenVertexArrays(1, &cylinderVAO));
+	GLCall(glGenBuffers(1, &cylinderBuffer));
+	GLCall(glBindVertexArray(cylinderVAO));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, cylinderBuffer));
+	GLCall(glBufferData(GL_ARRAY_BUFFER, cylinder.size() * sizeof(float), cylinder.data(), GL_STATIC_DRAW));
+	GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0));
+	GLCall(glEnableVertexAttribArray(0));
+
+	GLCall(glGenVertexArrays(1, &sphereVAO));
+	GLCall(glGenBuffers(1, &sphereBuffer));
+	GLCall(glGenBuffers(1, &sphereIndexBuffer));
+	GLCall(glBindVertexArray(sphereVAO));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, sphereBuffer));
+	GLCall(glBufferData(GL_ARRAY_BUFFER, sphere.size() * sizeof(float), sphere.data(), GL_STATIC_DRAW));
+	GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0));
+	GLCall(glEnableVertexAttribArray(0));
+	GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIndexBuffer));
+	GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(GLuint), sphereIndices.data(), GL_STATIC_DRAW));
+	GLCall(glBindVertexArray(0));
+	GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+	GLCall(glGenVertexArrays(1, &floorVAO));
+
+	std::vector<GLint> boneJoints;
+	for (int i = 0; i < boneCount; i++)
+	{
+		boneJoints.push_back(bones[i][0]);
+		boneJoints.push_back(bones[i][1]);
+	}
+
+	GLCall(glGenBuffers(1, &boneBuffer));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, boneBuffer));
+	GLCall(glBufferData(GL_TEXTURE_BUFFER, boneJoints.size() * sizeof(GLint), boneJoints.data(), GL_STATIC_DRAW));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+	GLCall(glGenTextures(1, &boneTexture));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, boneTexture));
+	GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32I, boneBuffer));
+
+	GLCall(glGenBuffers(1, &jointBuffer));
+	GLCall(glGenTextures(1, &jointTexture));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, jointBuffer));
+	GLCall(glBufferData(GL_TEXTURE_BUFFER, VIEWPORT_TEXELS * sizeof(RealJoint), NULL, GL_STREAM_DRAW));
+	GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, jointTexture));
+	GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, jointBuffer));
+	GLCall(glBindTexture(GL_TEXTURE_BUFFER, 0));
+
+	GLCall(glGenQueries(VIEWPORT_QUERY_COUNT, queries));
+}
+
+void SkeletonViewport::release()
+{
+	if (boneProgram)
+	{
+		GLCall(glDeleteVertexArrays(1, &cylinderVAO));
+		GLCall(glDeleteVertexArrays(1, &sphereVAO));
+		GLCall(glDeleteVertexArrays(1, &floorVAO));
+		GLCall(glDeleteBuffers(1, &cylinderBuffer));
+		GLCall(glDeleteBuffers(1, &sphereBuffer));
+		GLCall(glDeleteBuffers(1, &sphereIndexBuffer));
+		GLCall(glDeleteBuffers(1, &cameraBuffer));
+		GLCall(glDeleteBuffers(1, &boneBuffer));
+		GLCall(glDeleteTextures(1, &boneTexture));
+		GLCall(glDeleteBuffers(1, &jointBuffer));
+		GLCall(glDeleteTextures(1, &jointTexture));
+		GLCall(glDeleteQueries(VIEWPORT_QUERY_COUNT, queries));
+		boneProgram = 0;
+		jointProgram = 0;
+		floorProgram = 0;
+		memset(queries, 0, sizeof(queries));
+		memset(queryPending, 0, sizeof(queryPending));
+	}
+}
+
+void SkeletonViewport::setCamera(float targetX, float targetY, float targetZ, float yaw, float pitch, float distance)
+{
+	target[0] = targetX;
+	target[1] = targetY;
+	target[2] = targetZ;
+	this->yaw = yaw;
+	this->pitch = pitch;
+	this->distance = distance;
+}
+
+void SkeletonViewport::setFloor(const float* point, const float* normal)
+{
+	memcpy(floorPoint, point, sizeof(floorPoint));
+	memcpy(floorNormal, normal, sizeof(floorNormal));
+}
+
+void SkeletonViewport::begin()
+{
+	staging.clear();
+	skeletonCount = 0;
+}
+
+void SkeletonViewport::add(const RealJoint* joints, const float* boneColor, const float* jointColor)
+{
+	staging.insert(staging.end(), joints, joints + VIEWPORT_JOINT_COUNT);
+
+	// The colours are texels of the same buffer
+	RealJoint color = { boneColor[0], boneColor[1], boneColor[2], boneColor[3] };
+	staging.push_back(color);
+	color = { jointColor[0], jointColor[1], jointColor[2], jointColor[3] };
+	staging.push_back(color);
+
+	skeletonCount++;
+}
+
+void SkeletonViewport::add(const std::vector<tdv::nuitrack::Joint>& joints, const float* boneColor, const float* jointColor)
+{
+	RealJoint converted[VIEWPORT_JOINT_COUNT];
+	for (int i = 0; i < VIEWPORT_JOINT_COUNT; i++)
+	{
+		converted[i].x = joints[i].real.x;
+		converted[i].y = joints[i].real.y;
+		converted[i].z = joints[i].real.z;
+		converted[i].confidence = joints[i].confidence;
+	}
+
+	add(converted, boneColor, jointColor);
+}
+
+void SkeletonViewport::render(int x, int y, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	readQueries();
+
+	// Only time the render if the query slot is free, otherwise reading it back would stall
+	bool timed = !queryPending[nextQuery];
+	if (timed)
+	{
+		GLCall(glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]));
+	}
+
+	GLint viewport[4];
+	GLCall(glGetIntegerv(GL_VIEWPORT, viewport));
+	GLCall(glViewport(x, y, width, height));
+
+	// Clear only the part of the window the view covers
+	GLCall(glEnable(GL_SCISSOR_TEST));
+	GLCall(glScissor(x, y, width, height));
+	GLCall(glClearColor(0.08f, 0.08f, 0.1f, 1.0f));
+	GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+
+	CameraBlock camera;
+	Matrix4 view = CameraMath::orbit(target[0], target[1], target[2], yaw, pitch, distance);
+	Matrix4 projection = CameraMath::perspective(0.8f, (float)width / height, 100.0f, 20000.0f);
+	memcpy(camera.view, view.m, sizeof(camera.view));
+	memcpy(camera.projection, projection.m, sizeof(camera.projection));
+
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer));
+	GLCall(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &camera));
+	GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+	GLCall(glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraBuffer));
+
+	GLCall(glEnable(GL_DEPTH_TEST));
+
+	if (skeletonCount > 0)
+	{
+		// Orphaned every frame, only a few hundred bytes per skeleton
+		GLCall(glBindBuffer(GL_TEXTURE_BUFFER, jointBuffer));
+		GLCall(glBufferData(GL_TEXTURE_BUFFER, staging.size() * sizeof(RealJoint), staging.data(), GL_STREAM_DRAW));
+		GLCall(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+
+		GLCall(glActiveTexture(GL_TEXTURE2));
+		GLCall(glBindTexture(GL_TEXTURE_BUFFER, jointTexture));
+		GLCall(glActiveTexture(GL_TEXTURE3));
+		GLCall(glBindTexture(GL_TEXTURE_BUFFER, boneTexture));
+		GLCall(glActiveTexture(GL_TEXTURE0));
+
+		GLCall(glUseProgram(boneProgram));
+		GLCall(glUniform1i(boneCountUniformLocation, boneCount));
+		GLCall(glBindVertexArray(cylinderVAO));
+		GLCall(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, cylinderVertexCount, boneCount * skeletonCount));
+
+		GLCall(glUseProgram(jointProgram));
+		GLCall(glBindVertexArray(sphereVAO));
+		GLCall(glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, VIEWPORT_JOINT_COUNT * skeletonCount));
+	}
+
+	float normalLength = std::sqrt(floorNormal[0] * floorNormal[0] + floorNormal[1] * floorNormal[1] + floorNormal[2] * floorNormal[2]);
+	if (normalLength > 0.0f)
+	{
+		// Centred below the target, drawn last so the grid blends over what is behind it
+		float normal[3] = { floorNormal[0] / normalLength, floorNormal[1] / normalLength, floorNormal[2] / normalLength };
+		float elevation = (target[0] - floorPoint[0]) * normal[0] + (target[1] - floorPoint[1]) * normal[1] + (target[2] - floorPoint[2]) * normal[2];
+
+		GLCall(glEnable(GL_BLEND));
+		GLCall(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+		GLCall(glDepthMask(GL_FALSE));
+		GLCall(glUseProgram(floorProgram));
+		GLCall(glUniform3f(floorCenterUniformLocation, target[0] - elevation * normal[0], target[1] - elevation * normal[1], target[2] - elevation * normal[2]));
+		GLCall(glUniform3f(floorNormalUniformLocation, normal[0], normal[1], normal[2]));
+		GLCall(glBindVertexArray(floorVAO));
+		GLCall(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+		GLCall(glDepthMask(GL_TRUE));
+		GLCall(glDisable(GL_BLEND));
+	}
+
+	GLCall(glBindVertexArray(0));
+	GLCall(glDisable(GL_DEPTH_TEST));
+	GLCall(glDisable(GL_SCISSOR_TEST));
+	GLCall(glViewport(viewport[0], viewport[1], viewport[2], viewport[3]));
+
+	if (timed)
+	{
+		GLCall(glEndQuery(GL_TIME_ELAPSED));
+		queryPending[nextQuery] = true;
+		nextQuery = (nextQuery + 1) % VIEWPORT_QUERY_COUNT;
+	}
+}
+
+void SkeletonViewport::readQueries()
+{
+	for (int i = 0; i < VIEWPORT_QUERY_COUNT; i++)
+	{
+		if (!queryPending[i])
+			continue;
+
+		GLint available = 0;
+		GLCall(glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available));
+		if (!available)
+			continue;
+
+		GLuint64 elapsed = 0;
+		GLCall(glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed));
+		queryPending[i] = false;
+
+		gpuMs += TIMING_RATE * (elapsed / 1000000.0f - gpuMs);
+	}
+}
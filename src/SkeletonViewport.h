@@ -0,0 +1,92 @@
+#pragma once
+
+#include "opgl.h"
+#include "CameraMath.h"
+
+#include <nuitrack/Nuitrack.h>
+#include <vector>
+
+#define VIEWPORT_JOINT_COUNT 25
+// Texels per skeleton in the joint buffer: the joints, then the bone and the joint colour
+#define VIEWPORT_TEXELS (VIEWPORT_JOINT_COUNT + 2)
+#define VIEWPORT_QUERY_COUNT 4
+
+// Real world joint position in mm, Nuitrack coordinates
+struct RealJoint
+{
+	float x;
+	float y;
+	float z;
+	float confidence;
+};
+
+// Orbitable 3D view of the skeletons from their real world coordinates, drawn into a part of the window.
+// Bones are instanced cylinders and joints instanced spheres, placed by the vertex shaders from the
+// joint buffer like the 2D overlay does, so a frame uploads only the joints. The camera matrices
+// live in a uniform buffer shared by all programs. The floor Nuitrack detects is drawn as a grid.
+// Every render is timed with GL timer queries read back a few frames later.
+class SkeletonViewport
+{
+public:
+	SkeletonViewport();
+
+	// Needs a current GL context, bones are pairs of joint indices
+	void init(const int (*bones)[2], int boneCount);
+	void release();
+
+	// Orbit around a target in mm, angles in radians
+	void setCamera(float targetX, float targetY, float targetZ, float yaw, float pitch, float distance);
+	// Floor plane from the UserTracker, not drawn while the normal is zero
+	void setFloor(const float* point, const float* normal);
+
+	// Skeletons are collected between begin() and render(), colours are RGBA
+	void begin();
+	void add(const RealJoint* joints, const float* boneColor, const float* jointColor);
+	void add(const std::vector<tdv::nuitrack::Joint>& joints, const float* boneColor, const float* jointColor);
+
+	// Window rectangle in pixels from the bottom left
+	void render(int x, int y, int width, int height);
+
+	// Running average of the GPU time of render()
+	float getGpuMs() const { return gpuMs; }
+
+private:
+	int boneProgram;
+	int jointProgram;
+	int floorProgram;
+	GLuint cylinderVAO;
+	GLuint cylinderBuffer;
+	int cylinderVertexCount;
+	GLuint sphereVAO;
+	GLuint sphereBuffer;
+	GLuint sphereIndexBuffer;
+	int sphereIndexCount;
+	GLuint floorVAO; // Empty, the corners come from gl_VertexID
+	GLuint cameraBuffer;
+	GLuint boneBuffer; // Both joint indices of every bone, static
+	GLuint boneTexture;
+	GLuint jointBuffer;
+	GLuint jointTexture;
+	int boneCount;
+
+	int boneCountUniformLocation;
+	int floorCenterUniformLocation;
+	int floorNormalUniformLocation;
+
+	float yaw;
+	float pitch;
+	float distance;
+	float target[3];
+	float floorPoint[3];
+	float floorNormal[3];
+
+	std::vector<RealJoint> staging;
+	int skeletonCount;
+
+	GLuint queries[VIEWPORT_QUERY_COUNT];
+	bool queryPending[VIEWPORT_QUERY_COUNT];
+	int nextQuery;
+	float gpuMs;
+
+	void readQueries();
+};
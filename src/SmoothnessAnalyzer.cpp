@@ -0,0 +1,182 @@
+#include "SmoothnessAnalyzer.h"
+#include "NuitrackGL.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#define CUTOFF_FREQUENCY 10.0f // Hz, human movement is well below this
+#define AMPLITUDE_THRESHOLD 0.05f
+#define MIN_PEAK_SPEED 0.01f // Normalized units per second, anything slower is treated as no movement
+
+static const int trackedJoints[SMOOTHNESS_JOINT_COUNT] = {
+	tdv::nuitrack::JOINT_LEFT_HAND,
+	tdv::nuitrack::JOINT_RIGHT_HAND,
+	tdv::nuitrack::JOINT_LEFT_ANKLE,
+	tdv::nuitrack::JOINT_RIGHT_ANKLE
+};
+
+SmoothnessAnalyzer::SmoothnessAnalyzer(float sampleRate) :
+	fft(SMOOTHNESS_FFT_SIZE),
+	sampleRate(sampleRate),
+	window(SMOOTHNESS_WINDOW),
+	fftInput(SMOOTHNESS_FFT_SIZE, 0.0f),
+	spectrum(SMOOTHNESS_FFT_SIZE / 2 + 1)
+{
+	clear();
+}
+
+void SmoothnessAnalyzer::clear()
+{
+	memset(speeds, 0, sizeof(speeds));
+	memset(reports, 0, sizeof(reports));
+	sampleCount = 0;
+}
+
+void SmoothnessAnalyzer::addFrame(const JointFrame& frame)
+{
+	unsigned int index = sampleCount % SMOOTHNESS_WINDOW;
+
+	for (int i = 0; i < SMOOTHNESS_JOINT_COUNT; i++)
+	{
+		const Vector2& position = frame.joints[trackedJoints[i]];
+
+		if (sampleCount > 0)
+		{
+			float dx = position.x - lastPosition[i][0];
+			float dy = position.y - lastPosition[i][1];
+			speeds[i][index] = std::sqrt(dx * dx + dy * dy) * sampleRate;
+		}
+
+		lastPosition[i][0] = position.x;
+		lastPosition[i][1] = position.y;
+	}
+
+	sampleCount++;
+
+	if (sampleCount > SMOOTHNESS_WINDOW && sampleCount % SMOOTHNESS_HOP == 0)
+	{
+		for (int i = 0; i < SMOOTHNESS_JOINT_COUNT; i++)
+		{
+			// Live values follow the latest window rather than the average
+			reports[i].windows = 0;
+			computeWindow(i, reports[i]);
+		}
+	}
+}
+
+void SmoothnessAnalyzer::analyzeRecording(const std::vector<JointFrame>& frames, SmoothnessReport* results)
+{
+	clear();
+
+	for (int i = 0; i < SMOOTHNESS_JOINT_COUNT; i++)
+		memset(&results[i], 0, sizeof(SmoothnessReport));
+
+	for (size_t j = 0; j < frames.size(); j++)
+	{
+		addFrame(frames[j]);
+
+		if (sampleCount > SMOOTHNESS_WINDOW && sampleCount % SMOOTHNESS_HOP == 0)
+		{
+			for (int i = 0; i < SMOOTHNESS_JOINT_COUNT; i++)
+			{
+				if (reports[i].windows == 0)
+					continue;
+
+				// Running average over all windows
+				results[i].windows++;
+				results[i].sparc += (reports[i].sparc - results[i].sparc) / results[i].windows;
+				results[i].jerk += (reports[i].jerk - results[i].jerk) / results[i].windows;
+			}
+		}
+	}
+
+	clear();
+}
+
+void SmoothnessAnalyzer::computeWindow(int joint, SmoothnessReport& report)
+{
+	// Unroll the ring buffer so the oldest sample comes first
+	unsigned int start = sampleCount % SMOOTHNESS_WINDOW;
+	for (int i = 0; i < SMOOTHNESS_WINDOW; i++)
+		window[i] = speeds[joint][(start + i) % SMOOTHNESS_WINDOW];
+
+	float peak = *std::max_element(window.begin(), window.end());
+	if (peak < MIN_PEAK_SPEED)
+		return;
+
+	report.sparc = getSpectralArcLength();
+	report.jerk = getLogDimensionlessJerk();
+	report.windows = 1;
+}
+
+// Balasubramanian et al. 2015, "On the analysis of movement smoothness"
+float SmoothnessAnalyzer::getSpectralArcLength()
+{
+	std::copy(window.begin(), window.end(), fftInput.begin());
+	fft.magnitude(fftInput.data(), spectrum.data());
+
+	float maxMagnitude = *std::max_element(spectrum.begin(), spectrum.end());
+	if (maxMagnitude <= 0)
+		return 0.0f;
+
+	float frequencyStep = sampleRate / SMOOTHNESS_FFT_SIZE;
+	int cutoff = (std::min)((int)(CUTOFF_FREQUENCY / frequencyStep), (int)spectrum.size() - 1);
+
+	// Adaptive cutoff: the last bin below the cutoff frequency that is still above the amplitude threshold
+	int last = 0;
+	for (int k = 0; k <= cutoff; k++)
+	{
+		if (spectrum[k] / maxMagnitude >= AMPLITUDE_THRESHOLD)
+			last = k;
+	}
+
+	if (last == 0)
+		return 0.0f;
+
+	// Frequency is normalized by the selected bandwidth
+	float df = 1.0f / last;
+	float arcLength = 0.0f;
+
+	for (int k = 1; k <= last; k++)
+	{
+		float dm = (spectrum[k] - spectrum[k - 1]) / maxMagnitude;
+		arcLength += std::sqrt(df * df + dm * dm);
+	}
+
+	return -arcLength;
+}
+
+// Hogan & Sternad 2009, jerk of the speed profile normalized by duration and peak speed
+float SmoothnessAnalyzer::getLogDimensionlessJerk()
+{
+	float dt = 1.0f / sampleRate;
+	float duration = SMOOTHNESS_WINDOW * dt;
+	float peak = *std::max_element(window.begin(), window.end());
+
+	// Jerk of the position is the second derivative of the speed
+	double jerkSquared = 0;
+	for (int i = 1; i < SMOOTHNESS_WINDOW - 1; i++)
+	{
+		float jerk = (window[i + 1] - 2 * window[i] + window[i - 1]) / (dt * dt);
+		jerkSquared += jerk * jerk * dt;
+	}
+
+	double dimensionless = jerkSquared * duration * duration * duration / (peak * peak);
+	if (dimensionless <= 0)
+		return 0.0f;
+
+	return (float)-std::log(dimensionless);
+}
+
+const char* SmoothnessAnalyzer::getJointName(int joint)
+{
+	static const char* names[SMOOTHNESS_JOINT_COUNT] = {
+		"Left hand",
+		"Right hand",
+		"Left ankle",
+		"Right ankle"
+	};
+
+	return names[joint];
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "RealFFT.h"
+#include <vector>
+
+#define SMOOTHNESS_JOINT_COUNT 4
+#define SMOOTHNESS_WINDOW 128 // About 4 seconds at 30 FPS
+#define SMOOTHNESS_HOP 15 // Metrics are recomputed every half second at 30 FPS
+#define SMOOTHNESS_FFT_SIZE 2048 // The window is zero padded for a finer spectrum
+
+struct JointFrame;
+
+struct SmoothnessReport
+{
+	float sparc; // Spectral arc length, closer to 0 is smoother
+	float jerk; // Log dimensionless jerk, closer to 0 is smoother
+	int windows; // Number of windows the values are averaged over
+};
+
+// Movement smoothness of the hands and ankles over a sliding window of their speed.
+// Speeds are derived from consecutive JointFrames and kept in ring buffers, and the
+// FFT plan and scratch buffers are created once, so each window update only costs one
+// real FFT and a few passes over the window.
+class SmoothnessAnalyzer
+{
+public:
+	SmoothnessAnalyzer(float sampleRate = 30.0f);
+
+	void addFrame(const JointFrame& frame);
+	void clear();
+
+	const SmoothnessReport* getReports() const { return reports; }
+	static const char* getJointName(int joint);
+
+	// Runs the sliding window over a whole recording and averages the results
+	void analyzeRecording(const std::vector<JointFrame>& frames, SmoothnessReport* results);
+
+private:
+	RealFFT fft;
+	float sampleRate;
+
+	float speeds[SMOOTHNESS_JOINT_COUNT][SMOOTHNESS_WINDOW];
+	float lastPosition[SMOOTHNESS_JOINT_COUNT][2];
+	unsigned int sampleCount;
+
+	std::vector<float> window;
+	std::vector<float> fftInput;
+	std::vector<float> spectrum;
+
+	SmoothnessReport reports[SMOOTHNESS_JOINT_COUNT];
+
+	void computeWindow(int joint, SmoothnessReport& report);
+	float getSpectralArcLength();
+	float getLogDimensionlessJerk();
+};
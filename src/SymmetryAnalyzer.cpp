@@ -0,0 +1,191 @@
+#include "SymmetryAnalyzer.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#define MEAN_RATE 0.01f // Running mean follows roughly the last 100 frames
+#define CORRELATION_RATE 0.01f
+#define MIN_HYSTERESIS 5.0f // Degrees
+#define MIN_REP_FRAMES 10
+
+// Indices into userAngles for each left/right pair
+static const int pairIndices[SYMMETRY_PAIR_COUNT][2] = {
+	{ 0, 1 },   // Knees
+	{ 3, 4 },   // Hips
+	{ 5, 6 },   // Waist
+	{ 8, 9 },   // Collar
+	{ 10, 11 }, // Neck
+	{ 13, 14 }, // Shoulders
+	{ 15, 16 }, // Elbows
+	{ 17, 18 }  // Wrists
+};
+
+// Angles are anti-clockwise from 0-360 so the two sides of the body mirror each other.
+// Folding them to the interior angle makes them comparable.
+static float toInteriorAngle(int angle)
+{
+	return (float)(angle > 180 ? 360 - angle : angle);
+}
+
+SymmetryAnalyzer::SymmetryAnalyzer()
+{
+	clear();
+}
+
+void SymmetryAnalyzer::clear()
+{
+	memset(pairs, 0, sizeof(pairs));
+	frameCount = 0;
+}
+
+void SymmetryAnalyzer::update(const int* angles)
+{
+	for (int i = 0; i < SYMMETRY_PAIR_COUNT; i++)
+	{
+		updatePair(pairs[i], toInteriorAngle(angles[pairIndices[i][0]]), toInteriorAngle(angles[pairIndices[i][1]]));
+	}
+
+	frameCount++;
+}
+
+void SymmetryAnalyzer::updatePair(PairState& pair, float left, float right)
+{
+	const unsigned int mask = SYMMETRY_HISTORY - 1;
+
+	if (frameCount == 0)
+	{
+		pair.meanLeft = left;
+		pair.meanRight = right;
+	}
+
+	pair.meanLeft += MEAN_RATE * (left - pair.meanLeft);
+	pair.meanRight += MEAN_RATE * (right - pair.meanRight);
+
+	float dl = left - pair.meanLeft;
+	float dr = right - pair.meanRight;
+
+	pair.varianceLeft += CORRELATION_RATE * (dl * dl - pair.varianceLeft);
+	pair.varianceRight += CORRELATION_RATE * (dr * dr - pair.varianceRight);
+
+	unsigned int index = frameCount & mask;
+	pair.left[index] = dl;
+	pair.right[index] = dr;
+	pair.rawLeft[index] = left;
+	pair.rawRight[index] = right;
+
+	// A positive lag means the right side trails the left side
+	for (int lag = -SYMMETRY_MAX_LAG; lag <= SYMMETRY_MAX_LAG; lag++)
+	{
+		float product;
+		if (lag >= 0)
+			product = pair.left[(frameCount - lag) & mask] * dr;
+		else
+			product = dl * pair.right[(frameCount + lag) & mask];
+
+		float& cc = pair.crossCorrelation[lag + SYMMETRY_MAX_LAG];
+		cc += CORRELATION_RATE * (product - cc);
+	}
+
+	// Accumulate the current repetition, comparing the sides with the phase offset removed
+	if (pair.repFrames > 0)
+	{
+		float correlation;
+		int lag = getBestLag(pair, correlation);
+
+		float difference;
+		if (lag >= 0)
+			difference = std::fabs(pair.rawLeft[(frameCount - lag) & mask] - right);
+		else
+			difference = std::fabs(left - pair.rawRight[(frameCount + lag) & mask]);
+
+		pair.minLeft = (std::min)(pair.minLeft, left);
+		pair.maxLeft = (std::max)(pair.maxLeft, left);
+		pair.minRight = (std::min)(pair.minRight, right);
+		pair.maxRight = (std::max)(pair.maxRight, right);
+		pair.differenceSum += difference;
+		pair.repFrames++;
+	}
+
+	// A repetition goes from one upward crossing of the mean to the next
+	float hysteresis = (std::max)(MIN_HYSTERESIS, 0.5f * std::sqrt(pair.varianceLeft));
+
+	if (dl < -hysteresis)
+	{
+		pair.belowMean = true;
+	}
+	else if (dl > hysteresis && pair.belowMean)
+	{
+		pair.belowMean = false;
+
+		if (pair.repFrames >= MIN_REP_FRAMES)
+			finishRep(pair);
+
+		startRep(pair);
+		pair.minLeft = pair.maxLeft = left;
+		pair.minRight = pair.maxRight = right;
+	}
+}
+
+void SymmetryAnalyzer::startRep(PairState& pair)
+{
+	pair.differenceSum = 0;
+	pair.repFrames = 1;
+}
+
+void SymmetryAnalyzer::finishRep(PairState& pair)
+{
+	SymmetryReport& report = pair.report;
+
+	report.reps++;
+	report.leftRange = pair.maxLeft - pair.minLeft;
+	report.rightRange = pair.maxRight - pair.minRight;
+
+	float rangeSum = report.leftRange + report.rightRange;
+	report.symmetryIndex = rangeSum > 0 ? 200.0f * std::fabs(report.leftRange - report.rightRange) / rangeSum : 0.0f;
+	report.meanDifference = pair.differenceSum / pair.repFrames;
+	report.lag = getBestLag(pair, report.correlation);
+}
+
+int SymmetryAnalyzer::getBestLag(const PairState& pair, float& correlation) const
+{
+	float norm = std::sqrt(pair.varianceLeft * pair.varianceRight);
+
+	if (norm <= 0)
+	{
+		correlation = 0;
+		return 0;
+	}
+
+	int bestLag = 0;
+	float best = pair.crossCorrelation[SYMMETRY_MAX_LAG];
+
+	for (int lag = -SYMMETRY_MAX_LAG; lag <= SYMMETRY_MAX_LAG; lag++)
+	{
+		if (pair.crossCorrelation[lag + SYMMETRY_MAX_LAG] > best)
+		{
+			best = pair.crossCorrelation[lag + SYMMETRY_MAX_LAG];
+			bestLag = lag;
+		}
+	}
+
+	// The running estimates are not perfectly consistent with each other, keep the result in range
+	correlation = (std::min)(best / norm, 1.0f);
+	return bestLag;
+}
+
+const char* SymmetryAnalyzer::getPairName(int pair)
+{
+	static const char* names[SYMMETRY_PAIR_COUNT] = {
+		"Knees",
+		"Hips",
+		"Waist",
+		"Collar",
+		"Neck",
+		"Shoulders",
+		"Elbows",
+		"Wrists"
+	};
+
+	return names[pair];
+}
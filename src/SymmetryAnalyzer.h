@@ -0,0 +1,66 @@
+#pragma once
+
+#define SYMMETRY_PAIR_COUNT 8
+#define SYMMETRY_MAX_LAG 15 // In frames, half a second at 30 FPS
+#define SYMMETRY_HISTORY 32 // Must be a power of two larger than SYMMETRY_MAX_LAG
+
+// Result for the last completed repetition of a left/right pair
+struct SymmetryReport
+{
+	int reps;
+	float leftRange; // Range of motion in degrees
+	float rightRange;
+	float symmetryIndex; // Robinson symmetry index of the ranges, 0 is perfectly symmetric
+	float meanDifference; // Mean angle difference in degrees after phase correction
+	int lag; // Frames the right side trails the left side by
+	float correlation; // Normalized cross-correlation at that lag
+};
+
+// Compares the left and right joint angles of each pair frame by frame.
+// Phase offset between the sides is found with an exponentially weighted running
+// cross-correlation over a small range of lags, and repetitions are detected on the left side
+// with a hysteresis around its running mean. Every update is O(SYMMETRY_MAX_LAG) per pair
+// and nothing is allocated, so it can run in the skeleton callback.
+class SymmetryAnalyzer
+{
+public:
+	SymmetryAnalyzer();
+
+	void update(const int* angles);
+	void clear();
+
+	const SymmetryReport& getReport(int pair) const { return pairs[pair].report; }
+	static const char* getPairName(int pair);
+
+private:
+	struct PairState
+	{
+		float left[SYMMETRY_HISTORY]; // Mean removed samples
+		float right[SYMMETRY_HISTORY];
+		float rawLeft[SYMMETRY_HISTORY];
+		float rawRight[SYMMETRY_HISTORY];
+
+		float meanLeft;
+		float meanRight;
+		float varianceLeft;
+		float varianceRight;
+		float crossCorrelation[2 * SYMMETRY_MAX_LAG + 1];
+
+		// Current repetition
+		bool belowMean;
+		float minLeft, maxLeft;
+		float minRight, maxRight;
+		float differenceSum;
+		int repFrames;
+
+		SymmetryReport report;
+	};
+
+	PairState pairs[SYMMETRY_PAIR_COUNT];
+	unsigned int frameCount;
+
+	void updatePair(PairState& pair, float left, float right);
+	void finishRep(PairState& pair);
+	void startRep(PairState& pair);
+	int getBestLag(const PairState& pair, float& correlation) const;
+};
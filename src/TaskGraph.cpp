@@ -0,0 +1,90 @@
+#include "TaskGraph.h"
+
+TaskGraph::TaskGraph(WorkerPool& workers) :
+	workers(workers),
+	pending(0)
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+	// The running tasks still refer to the graph
+	wait();
+}
+
+TaskGraph::TaskID TaskGraph::add(std::function<void()> task, std::initializer_list<TaskID> dependencies)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	TaskID id = (TaskID)nodes.size();
+	nodes.push_back(Node());
+	Node& node = nodes.back();
+	node.task = std::move(task);
+	node.remaining = 0;
+	node.finished = false;
+
+	for (TaskID dependency : dependencies)
+	{
+		if (dependency < 0 || dependency >= id || nodes[dependency].finished)
+			continue;
+
+		nodes[dependency].dependents.push_back(id);
+		node.remaining++;
+	}
+
+	pending++;
+	if (node.remaining == 0)
+		start(id);
+
+	return id;
+}
+
+void TaskGraph::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	taskFinished.wait(lock, [this] { return pending == 0; });
+	nodes.clear();
+}
+
+void TaskGraph::wait(std::initializer_list<TaskID> tasks)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	taskFinished.wait(lock, [this, tasks]
+	{
+		for (TaskID id : tasks)
+		{
+			if (id >= 0 && id < (TaskID)nodes.size() && !nodes[id].finished)
+				return false;
+		}
+		return true;
+	});
+}
+
+void TaskGraph::start(TaskID id)
+{
+	// Moved out, the nodes can be reallocated by add() while the task runs
+	std::function<void()> task = std::move(nodes[id].task);
+
+	workers.submit([this, id, task]
+	{
+		task();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		finish(id);
+	});
+}
+
+void TaskGraph::finish(TaskID id)
+{
+	nodes[id].finished = true;
+
+	for (TaskID dependent : nodes[id].dependents)
+	{
+		if (--nodes[dependent].remaining == 0)
+			start(dependent);
+	}
+
+	// Any task can be the one a partial wait is waiting for
+	pending--;
+	taskFinished.notify_all();
+}
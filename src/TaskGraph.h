@@ -0,0 +1,49 @@
+#pragma once
+
+#include "WorkerPool.h"
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+
+// Tasks with dependencies on each other, run on a worker pool. A task is handed to the pool as
+// soon as every task it depends on has finished, so tasks that do not depend on each other run
+// side by side. The graph is filled again after every wait(), it is meant to be reused per frame.
+// Tasks added after a partial wait can still depend on the tasks it waited for.
+class TaskGraph final
+{
+public:
+	typedef int TaskID;
+
+	explicit TaskGraph(WorkerPool& workers);
+	~TaskGraph();
+
+	// Dependencies are IDs returned by earlier calls, negative IDs are ignored
+	// so optional tasks can be passed as -1
+	TaskID add(std::function<void()> task, std::initializer_list<TaskID> dependencies = {});
+	// Returns once every added task has finished and empties the graph
+	void wait();
+	// Returns once the given tasks have finished, the others keep running. Negative IDs are ignored.
+	void wait(std::initializer_list<TaskID> tasks);
+
+private:
+	struct Node
+	{
+		std::function<void()> task;
+		std::vector<TaskID> dependents;
+		int remaining; // Dependencies that have not finished yet
+		bool finished;
+	};
+
+	WorkerPool& workers;
+	std::vector<Node> nodes;
+	std::mutex mutex;
+	std::condition_variable taskFinished;
+	int pending;
+
+	// Both are called with the mutex held
+	void start(TaskID id);
+	void finish(TaskID id);
+};
@@ -0,0 +1,198 @@
+#include "TextureStreamer.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+#define TIMING_RATE 0.05f
+
+TextureStreamer::TextureStreamer() :
+	internalFormat(GL_RGB8),
+	format(GL_RGB),
+	type(GL_UNSIGNED_BYTE),
+	bytesPerPixel(3),
+	width(0),
+	height(0),
+	usePixelBuffers(true),
+	nextBuffer(0),
+	nextQuery(0)
+{
+	memset(buffers, 0, sizeof(buffers));
+	memset(fences, 0, sizeof(fences));
+	memset(bufferSizes, 0, sizeof(bufferSizes));
+	memset(queries, 0, sizeof(queries));
+	memset(queryPending, 0, sizeof(queryPending));
+	memset(&timing, 0, sizeof(timing));
+}
+
+void TextureStreamer::init(GLenum internalFormat, GLenum format, GLenum type, int bytesPerPixel)
+{
+	this->internalFormat = internalFormat;
+	this->format = format;
+	this->type = type;
+	this->bytesPerPixel = bytesPerPixel;
+
+	GLCall(glGenBuffers(STREAMER_BUFFER_COUNT, buffers));
+	GLCall(glGenQueries(STREAMER_QUERY_COUNT, queries));
+}
+
+void TextureStreamer::release()
+{
+	for (int i = 0; i < STREAMER_BUFFER_COUNT; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		bufferSizes[i] = 0;
+	}
+
+	if (buffers[0])
+	{
+		GLCall(glDeleteBuffers(STREAMER_BUFFER_COUNT, buffers));
+		GLCall(glDeleteQueries(STREAMER_QUERY_COUNT, queries));
+		memset(buffers, 0, sizeof(buffers));
+		memset(queries, 0, sizeof(queries));
+	}
+
+	memset(queryPending, 0, sizeof(queryPending));
+	width = 0;
+	height = 0;
+}
+
+void TextureStreamer::setUsePixelBuffers(bool use)
+{
+	if (use == usePixelBuffers)
+		return;
+
+	usePixelBuffers = use;
+
+	// Start averaging again so the two paths can be compared
+	timing.gpuMs = 0;
+	timing.cpuMs = 0;
+	timing.samples = 0;
+	timing.cpuSamples = 0;
+}
+
+void TextureStreamer::upload(GLuint texture, int width, int height, const void* data)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	readQueries();
+
+	// Only time the upload if the query slot is free, otherwise reading it back would stall
+	bool timed = !queryPending[nextQuery];
+	if (timed)
+	{
+		GLCall(glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]));
+	}
+
+	GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+	// Rows are tightly packed
+	GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+
+	if (width != this->width || height != this->height)
+	{
+		GLCall(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL));
+		this->width = width;
+		this->height = height;
+
+		// Timings are only comparable at the same resolution
+		memset(&timing, 0, sizeof(timing));
+		timing.width = width;
+		timing.height = height;
+	}
+
+	if (usePixelBuffers)
+		uploadThroughBuffer(width, height, data);
+	else
+	{
+		GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data));
+	}
+
+	GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+	if (timed)
+	{
+		GLCall(glEndQuery(GL_TIME_ELAPSED));
+		queryPending[nextQuery] = true;
+		nextQuery = (nextQuery + 1) % STREAMER_QUERY_COUNT;
+	}
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	// The GPU timings arrive frames later, the CPU side is averaged on its own
+	timing.cpuMs += (timing.cpuSamples == 0 ? 1.0f : TIMING_RATE) * (elapsed.count() - timing.cpuMs);
+	timing.cpuSamples++;
+}
+
+void TextureStreamer::uploadThroughBuffer(int width, int height, const void* data)
+{
+	GLsizeiptr size = (GLsizeiptr)width * height * bytesPerPixel;
+	int index = nextBuffer;
+	nextBuffer = (nextBuffer + 1) % STREAMER_BUFFER_COUNT;
+
+	GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[index]));
+
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+	if (size != bufferSizes[index])
+	{
+		GLCall(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+		bufferSizes[index] = size;
+	}
+	else if (fences[index] && glClientWaitSync(fences[index], 0, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		// The GPU still reads the last frame from this buffer, give it new storage instead of waiting
+		GLCall(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+	}
+	else
+	{
+		access |= GL_MAP_UNSYNCHRONIZED_BIT;
+	}
+
+	if (fences[index])
+	{
+		glDeleteSync(fences[index]);
+		fences[index] = 0;
+	}
+
+	GLCall(void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access));
+	if (mapped)
+	{
+		memcpy(mapped, data, size);
+		GLCall(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+		// With a pixel unpack buffer bound the data pointer is an offset into it
+		GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, 0));
+		GLCall(fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+		GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+	}
+	else
+	{
+		std::cout << "Mapping the pixel buffer failed, uploading directly" << std::endl;
+		GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+		GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data));
+	}
+}
+
+void TextureStreamer::readQueries()
+{
+	for (int i = 0; i < STREAMER_QUERY_COUNT; i++)
+	{
+		if (!queryPending[i])
+			continue;
+
+		GLint available = 0;
+		GLCall(glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available));
+		if (!available)
+			continue;
+
+		GLuint64 elapsed = 0;
+		GLCall(glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed));
+		queryPending[i] = false;
+
+		float ms = elapsed / 1000000.0f;
+		timing.gpuMs += (timing.samples == 0 ? 1.0f : TIMING_RATE) * (ms - timing.gpuMs);
+		timing.samples++;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "opgl.h"
+
+#define STREAMER_BUFFER_COUNT 3
+#define STREAMER_QUERY_COUNT 4
+
+struct UploadTiming
+{
+	float gpuMs; // Running average of the GL_TIME_ELAPSED of an upload
+	float cpuMs; // Running average of the time spent in upload()
+	int width;
+	int height;
+	int samples; // GPU timings read back
+	int cpuSamples;
+};
+
+// Streams frames into a texture through a ring of pixel buffer objects.
+// The frame is copied into a buffer the GPU is done with and glTexSubImage2D reads from that
+// buffer, so the driver copy overlaps with rendering instead of stalling on client memory.
+// A fence per buffer tells if it can be written without synchronization, otherwise its storage
+// is orphaned. Every upload is timed with GL timer queries read back a few frames later.
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+
+	// Needs a current GL context
+	void init(GLenum internalFormat, GLenum format, GLenum type, int bytesPerPixel);
+	void release();
+
+	// Reallocates the texture when the size changes
+	void upload(GLuint texture, int width, int height, const void* data);
+
+	// Direct uploads from client memory are kept to compare against
+	void setUsePixelBuffers(bool use);
+	bool getUsePixelBuffers() const { return usePixelBuffers; }
+	const UploadTiming& getTiming() const { return timing; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+private:
+	GLenum internalFormat;
+	GLenum format;
+	GLenum type;
+	int bytesPerPixel;
+	int width;
+	int height;
+	bool usePixelBuffers;
+
+	GLuint buffers[STREAMER_BUFFER_COUNT];
+	GLsync fences[STREAMER_BUFFER_COUNT];
+	GLsizeiptr bufferSizes[STREAMER_BUFFER_COUNT];
+	int nextBuffer;
+
+	GLuint queries[STREAMER_QUERY_COUNT];
+	bool queryPending[STREAMER_QUERY_COUNT];
+	int nextQuery;
+
+	UploadTiming timing;
+
+	void uploadThroughBuffer(int width, int height, const void* data);
+	void readQueries();
+};
@@ -0,0 +1,67 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(int threadCount) :
+	running(0),
+	stopping(false)
+{
+	if (threadCount <= 0)
+		threadCount = (int)std::thread::hardware_concurrency() - 1;
+	if (threadCount < 1)
+		threadCount = 1;
+
+	for (int i = 0; i < threadCount; i++)
+		threads.push_back(std::thread(&WorkerPool::run, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void WorkerPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	taskAvailable.notify_one();
+}
+
+void WorkerPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this] { return tasks.empty() && running == 0; });
+}
+
+void WorkerPool::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+		// Queued tasks are still run when the pool is destroyed
+		if (tasks.empty())
+			return;
+
+		std::function<void()> task = std::move(tasks.front());
+		tasks.pop_front();
+		running++;
+
+		lock.unlock();
+		task();
+		lock.lock();
+
+		running--;
+		if (tasks.empty() && running == 0)
+			idle.notify_all();
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Threads that stay alive for the lifetime of the pool and run the tasks handed to them
+// in the order they were submitted. Starting a thread costs far more than queueing a task.
+class WorkerPool final
+{
+public:
+	// 0 leaves one hardware thread for the render loop, at least one thread is started
+	explicit WorkerPool(int threadCount = 0);
+	~WorkerPool();
+
+	void submit(std::function<void()> task);
+	// Returns once every submitted task has finished
+	void wait();
+
+	int getThreadCount() const { return (int)threads.size(); }
+
+private:
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	std::condition_variable idle;
+	int running;
+	bool stopping;
+
+	void run();
+};
@@ -16,4 +16,20 @@ bool GLLogCall(const char* function, const char* file, int line)
         return false;
     }
     return true;
-}
\ No newline at end of file
+}
+
+// Polynomial approximation of the Turbo colormap
+const char turboColormapSource[] =
+"vec3 turbo(float x)\n"
+"{\n"
+"   const vec4 kRedVec4 = vec4(0.13572138, 4.61539260, -42.66032258, 132.13108234);\n"
+"   const vec4 kGreenVec4 = vec4(0.09140261, 2.19418839, 4.84296658, -14.18503333);\n"
+"   const vec4 kBlueVec4 = vec4(0.10667330, 12.64194608, -60.58204836, 110.36276771);\n"
+"   const vec2 kRedVec2 = vec2(-152.94239396, 59.28637943);\n"
+"   const vec2 kGreenVec2 = vec2(4.27729857, 2.82956604);\n"
+"   const vec2 kBlueVec2 = vec2(-89.90310912, 27.34824973);\n"
+"   x = clamp(x, 0.0, 1.0);\n"
+"   vec4 v4 = vec4(1.0, x, x * x, x * x * x);\n"
+"   vec2 v2 = v4.zw * v4.z;\n"
+"   return vec3(dot(v4, kRedVec4) + dot(v2, kRedVec2), dot(v4, kGreenVec4) + dot(v2, kGreenVec2), dot(v4, kBlueVec4) + dot(v2, kBlueVec2));\n"
+"}\n";
\ No newline at end of file
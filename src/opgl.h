@@ -7,3 +7,6 @@
 void GLClearError();
 
 bool GLLogCall(const char* function, const char* file, int line);
+
+// GLSL function vec3 turbo(float x), x in [0, 1]. Goes between the #version line and the shader body.
+extern const char turboColormapSource[];